@@ -0,0 +1,35 @@
+#include "distance_simd.hpp"
+#include <cmath>
+#include "simd_kernels.hpp"
+
+namespace rxy::simd {
+
+// the vector kernels of the cpu if any (simd_vec_kernels.hpp), else one row at a time
+void weighted_sq_distances(double const* x, double const* w, double const* cols, size_t stride, size_t dim,
+                           size_t begin, size_t end, double* out) {
+    if (auto k = vector_kernels()) return k->weighted_sq_distances(x, w, cols, stride, dim, begin, end, out);
+    for (size_t r = begin; r < end; ++r) {
+        double sum = 0;
+        for (size_t i = 0; i < dim; ++i) {
+            double d = x[i] - cols[i * stride + r];
+            sum += w[i] * d * d;
+        }
+        out[r - begin] = sum;
+    }
+}
+
+void pow_distances(double const* x, int p, double const* cols, size_t stride, size_t dim, size_t begin,
+                   size_t end, double* out) {
+    if (auto k = vector_kernels()) return k->pow_distances(x, p, cols, stride, dim, begin, end, out);
+    for (size_t r = begin; r < end; ++r) {
+        double sum = 0;
+        for (size_t i = 0; i < dim; ++i) {
+            double d = std::fabs(x[i] - cols[i * stride + r]), t = d;
+            for (int k = 1; k < p; ++k) t *= d;
+            sum += t;
+        }
+        out[r - begin] = sum;
+    }
+}
+
+}  // namespace rxy::simd
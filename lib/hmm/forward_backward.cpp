@@ -0,0 +1,189 @@
+#include "forward_backward.hpp"
+#include "prob_simd.hpp"
+#include <algorithm>
+#include <execution>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace rxy {
+
+using value_type = Prob::value_type;
+
+/**
+ * @brief divides the row by its sum, in log space. Returns the log sum, the row is left as it is if
+ * the sum is ZERO.
+ * */
+static value_type normalize(value_type* row, size_t N) {
+    // the vector kernel per block, the blocks reduced in parallel
+    static constexpr size_t BLOCK = 1 << 14;
+    Prob sum;
+    if (N <= BLOCK) {
+        sum = {simd::log_sum_exp(row, N), true};
+    } else {
+        std::vector<size_t> blocks((N + BLOCK - 1) / BLOCK);
+        std::iota(blocks.begin(), blocks.end(), 0);
+        sum = std::transform_reduce(std::execution::par_unseq, blocks.begin(), blocks.end(), Prob::ZERO,
+                                    std::plus<>(), [row, N](size_t b) {
+                                        auto first = row + b * BLOCK;
+                                        auto n = std::min(BLOCK, N - b * BLOCK);
+                                        return Prob(simd::log_sum_exp(first, n), true);
+                                    });
+    }
+    if (sum == Prob::ZERO) return sum.prob;
+    std::for_each(std::execution::par_unseq, row, row + N, [s = sum.prob](value_type& v) { v -= s; });
+    return sum.prob;
+}
+
+static uint32_t argmax(std::span<value_type const> row) {
+    return static_cast<uint32_t>(std::max_element(row.begin(), row.end()) - row.begin());
+}
+
+static Point expectation(StateIndex const& index, std::span<value_type const> row) {
+    Point ret(0, 0);
+    for (uint32_t l = 0; l < row.size(); ++l) {
+        if (row[l] != Prob::ZERO.prob) ret += index[l]->point * std::exp(row[l]);
+    }
+    return ret;
+}
+
+/**
+ * alpha[t][l] = P(L_t = l, X_0..X_t) / c_t = sum_{l'} alpha[t - 1][l'] * P(l' -> l) * P(l -> r) / c_t
+ * beta[t][l'] = P(X_{t+1}..X_{T-1} | L_t = l') / d_t = sum_{l} P(l' -> l) * P(l -> r) * beta[t + 1][l] / d_t
+ * posterior[t][l] = alpha[t][l] * beta[t][l] / sum_{l} alpha[t][l] * beta[t][l]
+ * where c_t and d_t normalize every step: the scales cancel out in the posterior.
+ * */
+std::vector<value_type> forward_backward(std::vector<Transition const*> const& transitions,
+                                         std::vector<value_type> const& init,
+                                         std::vector<value_type> const& emissions) {
+    auto N = init.size();
+    if (N == 0) throw std::runtime_error("N == 0");
+    if (emissions.size() % N != 0) throw std::runtime_error("emissions.size() % N != 0");
+    auto T = emissions.size() / N;
+    if (T == 0) throw std::runtime_error("T == 0");
+    if (transitions.size() != T - 1) throw std::runtime_error("transitions.size() != T - 1");
+    for (auto&& transition : transitions) {
+        if (transition->size() != N) throw std::runtime_error("transition->size() != N");
+    }
+
+    std::vector<value_type> alpha(T * N), beta(T * N), next(N);
+
+    auto init_at = [&init, &emissions, &alpha, N](size_t t) {
+        auto cur = alpha.data() + t * N;
+        auto et = emissions.data() + t * N;
+        for (size_t l = 0; l < N; ++l) cur[l] = init[l] + et[l];
+        if (normalize(cur, N) == Prob::ZERO.prob) {
+            throw std::runtime_error("all zero for t = " + std::to_string(t));
+        }
+    };
+
+    // the first time step of every segment
+    std::vector<size_t> starts{0};
+    init_at(0);
+    for (size_t t = 1; t < T; ++t) {
+        auto cur = alpha.data() + t * N;
+        transitions[t - 1]->sum_product(alpha.data() + (t - 1) * N, cur);
+        auto et = emissions.data() + t * N;
+        for (size_t l = 0; l < N; ++l) cur[l] += et[l];
+        if (normalize(cur, N) == Prob::ZERO.prob) {
+#ifdef DEBUG
+            std::cout << t << ": re-init" << std::endl;
+#endif
+            init_at(t);
+            starts.push_back(t);
+        }
+    }
+    starts.push_back(T);
+
+    // the segments are independent: the backward pass restarts from ONE at the end of each
+    for (size_t i = 0; i + 1 < starts.size(); ++i) {
+        auto last = starts[i + 1] - 1;
+        std::fill(beta.begin() + last * N, beta.begin() + (last + 1) * N, Prob::ONE.prob);
+        for (auto t = last; t-- > starts[i];) {
+            auto bt = beta.data() + (t + 1) * N;
+            auto et = emissions.data() + (t + 1) * N;
+            for (size_t l = 0; l < N; ++l) next[l] = bt[l] + et[l];
+            transitions[t]->sum_product_transposed(next.data(), beta.data() + t * N);
+            normalize(beta.data() + t * N, N);
+        }
+    }
+
+    for (size_t t = 0; t < T; ++t) {
+        auto at = alpha.data() + t * N;
+        auto bt = beta.data() + t * N;
+        for (size_t l = 0; l < N; ++l) at[l] += bt[l];
+        normalize(at, N);
+    }
+    return alpha;
+}
+
+Posterior::Posterior(StateIndexPtr index, std::vector<value_type> log_prob)
+    : index(std::move(index)), log_prob(std::move(log_prob)) {
+    auto N = this->index->size();
+    if (N == 0 || this->log_prob.size() % N != 0) throw std::runtime_error("log_prob.size() % N != 0");
+    T = this->log_prob.size() / N;
+}
+
+LocationPtr Posterior::best(size_t t) const { return (*index)[argmax((*this)[t])]; }
+
+Point Posterior::expected(size_t t) const { return expectation(*index, (*this)[t]); }
+
+ForwardFilter::ForwardFilter(StateIndexPtr index, std::unordered_map<LocKey, Prob> const& init_prob)
+    : index(std::move(index)), resolve(this->index) {
+    auto N = this->index->size();
+    if (init_prob.size() != N) throw std::runtime_error("init_prob.size() != N");
+    init.resize(N);
+    for (uint32_t l = 0; l < N; ++l) {
+        init[l] = init_prob.at(this->index->key(l)).prob;
+    }
+    alpha.resize(N);
+    cur.resize(N);
+    emission.resize(N);
+}
+
+void ForwardFilter::re_init() {
+    auto N = index->size();
+    for (uint32_t l = 0; l < N; ++l) alpha[l] = init[l] + emission[l];
+    if (normalize(alpha.data(), N) == Prob::ZERO.prob) {
+        throw std::runtime_error("all zero for t = " + std::to_string(T));
+    }
+}
+
+std::span<value_type const> ForwardFilter::push(MarkovPtr const& markov, EmissionProb const& emission_prob) {
+    auto N = index->size();
+    if (emission_prob.size() != N) throw std::runtime_error("emission.size() != N");
+    for (uint32_t l = 0; l < N; ++l) {
+        emission[l] = emission_prob.at(index->key(l)).prob;
+    }
+
+    if (T == 0) {
+        re_init();
+        ++T;
+        return alpha;
+    }
+
+    auto& transition = resolve(*markov);
+    if (transition.size() != N) throw std::runtime_error("transition.size() != N");
+    transition.sum_product(alpha.data(), cur.data());
+    for (uint32_t l = 0; l < N; ++l) cur[l] += emission[l];
+    if (normalize(cur.data(), N) == Prob::ZERO.prob) {
+#ifdef DEBUG
+        std::cout << T << ": re-init" << std::endl;
+#endif
+        re_init();
+    } else {
+        alpha.swap(cur);
+    }
+    ++T;
+    return alpha;
+}
+
+LocationPtr ForwardFilter::best() const { return (*index)[argmax(alpha)]; }
+
+Point ForwardFilter::expected() const { return expectation(*index, alpha); }
+
+}  // namespace rxy
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * @brief Batched distances from one query to many rows of a ColumnMatrix, the building blocks of
+ * the KNN metrics. Same instruction set selection as prob_simd.hpp.
+ * */
+namespace rxy::simd {
+
+/**
+ * @brief out[r - begin] = sum_i w[i] * (x[i] - cols[i * stride + r])^2 for r in [begin, end).
+ * */
+void weighted_sq_distances(double const* x, double const* w, double const* cols, size_t stride, size_t dim,
+                           size_t begin, size_t end, double* out);
+
+/**
+ * @brief out[r - begin] = sum_i |x[i] - cols[i * stride + r]|^p for r in [begin, end), p >= 1.
+ * */
+void pow_distances(double const* x, int p, double const* cols, size_t stride, size_t dim, size_t begin,
+                   size_t end, double* out);
+
+}  // namespace rxy::simd
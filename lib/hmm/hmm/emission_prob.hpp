@@ -7,6 +7,6 @@
 namespace rxy {
 
 // A wrapper which wraps a markov emission probability function.
-using EmissionProb = std::unordered_map<LocationPtr, Prob>;
+using EmissionProb = std::unordered_map<LocKey, Prob>;
 
 }  // namespace rxy
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "emission_prob.hpp"
+#include "location.hpp"
+#include "markov.hpp"
+#include "probability.hpp"
+#include "state_index.hpp"
+#include "transition.hpp"
+
+namespace rxy {
+
+/**
+ * @brief Forward-backward over dense state indices [0, N), with the same inputs as viterbi (see
+ * viterbi.hpp). Both passes are scaled: every step is normalized, so that long traces do not
+ * underflow. If every state of the forward pass becomes ZERO, the recursion is re-initialized there
+ * and the trace is decoded as two independent segments, as viterbi does.
+ * @return the log posterior P(L_t = l | X_0..X_{T-1}), row-major T x N.
+ * */
+std::vector<Prob::value_type> forward_backward(std::vector<Transition const*> const& transitions,
+                                               std::vector<Prob::value_type> const& init,
+                                               std::vector<Prob::value_type> const& emissions);
+
+/**
+ * @brief Marginal posteriors of every time step, over the states of a StateIndex.
+ * */
+class Posterior {
+   public:
+    using value_type = Prob::value_type;
+
+   private:
+    StateIndexPtr index;
+    size_t T;
+    std::vector<value_type> log_prob;
+
+   public:
+    Posterior(StateIndexPtr index, std::vector<value_type> log_prob);
+
+    size_t size() const { return T; }
+
+    StateIndex const& get_state_index() const { return *index; }
+
+    // log P(L_t = l | X) of every state l of the index
+    std::span<value_type const> operator[](size_t t) const {
+        return {log_prob.data() + t * index->size(), index->size()};
+    }
+
+    Prob at(size_t t, LocationPtr const& loc) const { return {(*this)[t][index->at(loc)], true}; }
+
+    // the marginally most probable location of time t
+    LocationPtr best(size_t t) const;
+
+    // E[L_t]: the points of the locations weighted by their posterior
+    Point expected(size_t t) const;
+};
+
+/**
+ * @brief Streaming forward-only filter: observations are pushed one time step at a time and every
+ * push returns the filtered posterior P(L_t | X_0..X_t). It is the live counterpart of Posterior,
+ * whose smoothed estimates need the whole trace.
+ * */
+class ForwardFilter {
+   public:
+    using value_type = Prob::value_type;
+
+   private:
+    StateIndexPtr index;
+    std::vector<value_type> init;
+    // number of pushed time steps
+    size_t T = 0;
+    std::vector<value_type> alpha, cur, emission;
+    TransitionResolver resolve;
+
+    void re_init();
+
+   public:
+    ForwardFilter(StateIndexPtr index, std::unordered_map<LocKey, Prob> const& init);
+
+    /**
+     * @param markov: the transition from the previous time step, ignored for the first one.
+     * @param emission: the rsrp emission probability P(X|L) of the new time step.
+     * @return the log filtered posterior of every state of the index.
+     * */
+    std::span<value_type const> push(MarkovPtr const& markov, EmissionProb const& emission);
+
+    // the next push starts a new trace
+    void reset() { T = 0; }
+
+    size_t size() const { return T; }
+
+    std::span<value_type const> posterior() const { return alpha; }
+
+    LocationPtr best() const;
+
+    Point expected() const;
+};
+
+}  // namespace rxy
@@ -1,8 +1,11 @@
 #pragma once
 #include "emission_prob.hpp"
+#include "forward_backward.hpp"
 #include "location.hpp"
 #include "markov.hpp"
 #include "probability.hpp"
+#include "state_index.hpp"
+#include "viterbi.hpp"
 #include <unordered_set>
 #include <string>
 
@@ -10,24 +13,23 @@ namespace rxy {
 
 class HMM {
    private:
-    std::unordered_set<LocationPtr> const *loc_set;
-    const bool is_move_in;
+    StateIndexPtr index;
 
    public:
-    HMM(std::unordered_set<LocationPtr> const &loc_set) : loc_set(&loc_set), is_move_in(false) {}
-    HMM(std::unordered_set<LocationPtr> &&loc_set)
-        : loc_set(new std::unordered_set<LocationPtr>(std::move(loc_set))), is_move_in(true) {}
+    HMM(std::unordered_set<LocationPtr> const &loc_set)
+        : index(std::make_shared<StateIndex>(loc_set)) {}
+    HMM(StateIndexPtr index) : index(std::move(index)) {}
 
-    ~HMM() {
-        if (is_move_in && loc_set != nullptr) {
-            delete loc_set;
-            loc_set = nullptr;
-        }
-    }
+    StateIndex const &get_state_index() const { return *index; }
 
     std::vector<LocationPtr> const viterbi(std::vector<MarkovPtr> const &markovs,
-                                           std::unordered_map<LocationPtr, Prob> const &init,
-                                           std::vector<EmissionProb> const &emission_probs) const;
+                                           std::unordered_map<LocKey, Prob> const &init,
+                                           std::vector<EmissionProb> const &emission_probs,
+                                           Beam const &beam = {}) const;
+
+    Posterior forward_backward(std::vector<MarkovPtr> const &markovs,
+                               std::unordered_map<LocKey, Prob> const &init,
+                               std::vector<EmissionProb> const &emission_probs) const;
 };
 
-}  // namespace rxy
\ No newline at end of file
+}  // namespace rxy
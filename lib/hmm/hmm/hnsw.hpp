@@ -0,0 +1,237 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+
+namespace rxy {
+
+struct HNSWParams {
+    // the max number of links of a node on the upper layers, 2 * M on layer 0
+    size_t M = 16;
+    // the size of the candidate list while inserting: the quality of the graph
+    size_t ef_construction = 200;
+    // the size of the candidate list while searching, at least k: the recall / latency knob
+    size_t ef = 0;
+};
+
+/**
+ * @brief Hierarchical navigable small world graph (Malkov & Yashunin) over the rows of a dataset,
+ * an approximate nearest neighbour index for any distance of the metric policies (see metric.hpp).
+ * Every row is linked to its nearest rows on layer 0 and, with an exponentially decaying
+ * probability, on the sparser upper layers; a query descends greedily from the top layer, then
+ * keeps the ef best candidates of a best-first walk on layer 0. The k nearest of them are returned:
+ * the recall grows with ef, and so does the latency.
+ * */
+template <typename T, class Metric>
+class HNSW {
+   private:
+    using Candidate = std::pair<double, uint32_t>;
+    // the nearest candidate on top, the farthest one on top
+    using MinHeap = std::priority_queue<Candidate, std::vector<Candidate>, std::greater<>>;
+    using MaxHeap = std::priority_queue<Candidate>;
+
+    Metric metric;
+    size_t dim = 0, M = 16, M0 = 32, ef_construction = 200;
+    // the rows, one after another, for the distance between two of them
+    std::vector<T> points;
+    // the links of layer 0: M0 + 1 values per node, the count first
+    std::vector<uint32_t> base;
+    // the links of the upper layers of every node: M + 1 values per layer, the count first
+    std::vector<std::vector<uint32_t>> upper;
+    std::vector<int> levels;
+    uint32_t entry = 0;
+    int max_level = -1;
+
+    T const* point(uint32_t id) const { return points.data() + id * dim; }
+
+    double distance(T const* x, uint32_t id) const { return metric.distance(x, point(id), dim); }
+
+    uint32_t* links(uint32_t id, int level) {
+        return level == 0 ? base.data() + id * (M0 + 1) : upper[id].data() + (level - 1) * (M + 1);
+    }
+
+    uint32_t const* links(uint32_t id, int level) const {
+        return level == 0 ? base.data() + id * (M0 + 1) : upper[id].data() + (level - 1) * (M + 1);
+    }
+
+    // marks the nodes visited by a walk, cleared by bumping the tag
+    struct Visited {
+        std::vector<uint32_t> tags;
+        uint32_t tag = 0;
+
+        void reset(size_t n) {
+            if (tags.size() < n) tags.resize(n, 0);
+            if (++tag == 0) {
+                std::fill(tags.begin(), tags.end(), 0);
+                tag = 1;
+            }
+        }
+
+        // true the first time
+        bool visit(uint32_t id) { return tags[id] != tag ? (tags[id] = tag, true) : false; }
+    };
+
+    // greedy walk on a layer to the node nearest to x
+    Candidate greedy(T const* x, Candidate cur, int level) const {
+        for (bool changed = true; changed;) {
+            changed = false;
+            auto l = links(cur.second, level);
+            for (uint32_t i = 1; i <= l[0]; ++i) {
+                auto d = distance(x, l[i]);
+                if (d < cur.first) {
+                    cur = {d, l[i]};
+                    changed = true;
+                }
+            }
+        }
+        return cur;
+    }
+
+    // best-first walk on a layer from the entry, the ef nearest nodes found, nearest first
+    std::vector<Candidate> search_layer(T const* x, Candidate start, size_t ef, int level) const {
+        thread_local Visited visited;
+        visited.reset(levels.size());
+        visited.visit(start.second);
+        MinHeap candidates;
+        MaxHeap found;
+        candidates.push(start);
+        found.push(start);
+        while (!candidates.empty()) {
+            auto [d, id] = candidates.top();
+            if (d > found.top().first && found.size() >= ef) break;
+            candidates.pop();
+            auto l = links(id, level);
+            for (uint32_t i = 1; i <= l[0]; ++i) {
+                if (!visited.visit(l[i])) continue;
+                auto dn = distance(x, l[i]);
+                if (found.size() < ef || dn < found.top().first) {
+                    candidates.emplace(dn, l[i]);
+                    found.emplace(dn, l[i]);
+                    if (found.size() > ef) found.pop();
+                }
+            }
+        }
+        std::vector<Candidate> ret(found.size());
+        for (auto it = ret.rbegin(); it != ret.rend(); ++it) {
+            *it = found.top();
+            found.pop();
+        }
+        return ret;
+    }
+
+    /**
+     * @brief keeps at most m of the candidates (nearest first), skipping the ones nearer to an
+     * already kept node than to the query: the links then spread in all directions.
+     * */
+    std::vector<uint32_t> select(std::vector<Candidate> const& candidates, size_t m) const {
+        std::vector<uint32_t> ret;
+        ret.reserve(m);
+        for (auto [d, id] : candidates) {
+            if (ret.size() == m) break;
+            bool keep = std::all_of(ret.begin(), ret.end(),
+                                    [this, d = d, id = id](uint32_t kept) { return distance(point(id), kept) >= d; });
+            if (keep) ret.push_back(id);
+        }
+        return ret;
+    }
+
+    void link(uint32_t from, uint32_t to, int level) {
+        auto cap = level == 0 ? M0 : M;
+        auto l = links(from, level);
+        if (l[0] < cap) {
+            l[++l[0]] = to;
+            return;
+        }
+        // full: select again among the old links and the new one
+        std::vector<Candidate> candidates;
+        candidates.reserve(cap + 1);
+        candidates.emplace_back(distance(point(from), to), to);
+        for (uint32_t i = 1; i <= l[0]; ++i) candidates.emplace_back(distance(point(from), l[i]), l[i]);
+        std::sort(candidates.begin(), candidates.end());
+        auto kept = select(candidates, cap);
+        l[0] = static_cast<uint32_t>(kept.size());
+        std::copy(kept.begin(), kept.end(), l + 1);
+    }
+
+    void insert(uint32_t id, int level) {
+        levels[id] = level;
+        upper[id].assign(level * (M + 1), 0);
+        if (max_level < 0) {
+            entry = id;
+            max_level = level;
+            return;
+        }
+        auto x = point(id);
+        Candidate cur{distance(x, entry), entry};
+        for (auto l = max_level; l > level; --l) cur = greedy(x, cur, l);
+        for (auto l = std::min(level, max_level); l >= 0; --l) {
+            auto found = search_layer(x, cur, ef_construction, l);
+            auto neighbours = select(found, M);
+            auto own = links(id, l);
+            own[0] = static_cast<uint32_t>(neighbours.size());
+            std::copy(neighbours.begin(), neighbours.end(), own + 1);
+            for (auto n : neighbours) link(n, id, l);
+            cur = found.front();
+        }
+        if (level > max_level) {
+            entry = id;
+            max_level = level;
+        }
+    }
+
+   public:
+    HNSW() = default;
+
+    HNSW(ColumnMatrix<T> const& data, Metric metric, HNSWParams const& params)
+        : metric(std::move(metric)),
+          dim(data.dim()),
+          M(params.M),
+          M0(2 * params.M),
+          ef_construction(std::max(params.ef_construction, params.M)) {
+        if (data.rows() == 0) throw std::invalid_argument("HNSW: empty data");
+        if (params.M < 2) throw std::invalid_argument("HNSW: M < 2");
+        auto N = data.rows();
+        points.resize(N * dim);
+        for (size_t r = 0; r < N; ++r) {
+            for (size_t i = 0; i < dim; ++i) points[r * dim + i] = data(r, i);
+        }
+        base.assign(N * (M0 + 1), 0);
+        upper.resize(N);
+        levels.resize(N);
+        // the level of a node is geometric of ratio 1 / M, seeded: the graph is reproducible
+        std::mt19937 gen(100);
+        std::uniform_real_distribution<double> unif(0, 1);
+        double ml = 1 / std::log(static_cast<double>(M));
+        for (uint32_t id = 0; id < N; ++id) {
+            insert(id, static_cast<int>(-std::log(1 - unif(gen)) * ml));
+        }
+    }
+
+    /**
+     * @param ef: the size of the candidate list, raised to k.
+     * @return the k (approximately) nearest (distance, row), nearest first.
+     * */
+    std::vector<Candidate> query(T const* x, size_t k, size_t ef) const {
+        Candidate cur{distance(x, entry), entry};
+        for (auto l = max_level; l > 0; --l) cur = greedy(x, cur, l);
+        auto found = search_layer(x, cur, std::max(ef, k), 0);
+        if (found.size() > k) found.resize(k);
+        return found;
+    }
+
+    size_t memory() const {
+        size_t ret = points.capacity() * sizeof(T) + base.capacity() * sizeof(uint32_t);
+        for (auto& u : upper) ret += u.capacity() * sizeof(uint32_t);
+        return ret;
+    }
+};
+
+}  // namespace rxy
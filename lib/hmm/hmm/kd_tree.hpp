@@ -0,0 +1,178 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+
+namespace rxy {
+
+/**
+ * @brief Bounded max-heap of the k nearest (distance, row) candidates, the ties broken by row so
+ * that the result does not depend on the visiting order.
+ * */
+class TopK {
+   private:
+    size_t k;
+    std::priority_queue<std::pair<double, uint32_t>> heap;
+
+   public:
+    explicit TopK(size_t k) : k(k) {}
+
+    // the distance a candidate has to beat
+    double bound() const { return heap.size() < k ? std::numeric_limits<double>::infinity() : heap.top().first; }
+
+    void push(double d, uint32_t row) {
+        if (heap.size() < k) {
+            heap.emplace(d, row);
+        } else if (std::make_pair(d, row) < heap.top()) {
+            heap.pop();
+            heap.emplace(d, row);
+        }
+    }
+
+    // the candidates, nearest first
+    std::vector<std::pair<double, uint32_t>> take() {
+        std::vector<std::pair<double, uint32_t>> ret(heap.size());
+        for (auto it = ret.rbegin(); it != ret.rend(); ++it) {
+            *it = heap.top();
+            heap.pop();
+        }
+        return ret;
+    }
+};
+
+/**
+ * @brief KD-tree over the rows of a dataset, for the diagonal metrics (see metric.hpp): the
+ * distances sqrt(sum_i w_i * (x_i - y_i)^2) whose weights w only depend on the query x, i.e.
+ * euclidean, weighted and inverse-weighted euclidean. The nodes keep their bounding boxes, a subtree
+ * is skipped when the weighted distance from the query to its box cannot beat the current k-th
+ * neighbour, so the search is exact. The leaves are scored by the batched kernel of the metric.
+ * */
+template <typename T>
+class KDTree {
+   private:
+    static constexpr size_t LEAF_SIZE = 32;
+
+    struct Node {
+        // rows [begin, end) of the tree order
+        uint32_t begin, end;
+        // children, 0 for a leaf (the root is never a child)
+        uint32_t left = 0, right = 0;
+    };
+
+    size_t dim = 0;
+    // the rows in tree order, so that a leaf is contiguous
+    ColumnMatrix<T> points;
+    // tree order -> row of the dataset
+    std::vector<uint32_t> rows;
+    std::vector<Node> nodes;
+    // bounding box of every node: lo and hi, dim values each
+    std::vector<T> lo, hi;
+    // the size of the largest leaf, all the rows of a leaf may be the same point
+    size_t max_leaf = 0;
+
+    uint32_t build(uint32_t begin, uint32_t end, ColumnMatrix<T> const& data) {
+        auto id = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({begin, end});
+        lo.resize(lo.size() + dim);
+        hi.resize(hi.size() + dim);
+        size_t split = 0;
+        T widest = 0;
+        for (size_t i = 0; i < dim; ++i) {
+            auto [mn, mx] = std::minmax_element(rows.begin() + begin, rows.begin() + end,
+                                                [&data, i](uint32_t a, uint32_t b) { return data(a, i) < data(b, i); });
+            lo[id * dim + i] = data(*mn, i);
+            hi[id * dim + i] = data(*mx, i);
+            if (hi[id * dim + i] - lo[id * dim + i] > widest) {
+                widest = hi[id * dim + i] - lo[id * dim + i];
+                split = i;
+            }
+        }
+        // a leaf, or all the rows are the same point
+        if (end - begin <= LEAF_SIZE || widest == 0) {
+            max_leaf = std::max<size_t>(max_leaf, end - begin);
+            return id;
+        }
+        auto mid = begin + (end - begin) / 2;
+        std::nth_element(rows.begin() + begin, rows.begin() + mid, rows.begin() + end,
+                         [&data, split](uint32_t a, uint32_t b) { return data(a, split) < data(b, split); });
+        auto left = build(begin, mid, data);
+        auto right = build(mid, end, data);
+        nodes[id].left = left;
+        nodes[id].right = right;
+        return id;
+    }
+
+    // weighted squared distance from x to the box of the node
+    double box_distance(uint32_t id, T const* x, double const* w) const {
+        double sum = 0;
+        auto l = lo.data() + id * dim, h = hi.data() + id * dim;
+        for (size_t i = 0; i < dim; ++i) {
+            double d = 0;
+            if (x[i] < l[i]) {
+                d = static_cast<double>(l[i]) - x[i];
+            } else if (x[i] > h[i]) {
+                d = static_cast<double>(x[i]) - h[i];
+            }
+            sum += w[i] * d * d;
+        }
+        return sum;
+    }
+
+    template <class Metric>
+    void search(Metric const& metric, uint32_t id, T const* x, double const* w, TopK& top, double* buf) const {
+        auto& node = nodes[id];
+        if (node.left == 0) {
+            metric.scores(x, w, points, node.begin, node.end, buf);
+            for (auto k = node.begin; k < node.end; ++k) top.push(buf[k - node.begin], rows[k]);
+            return;
+        }
+        auto dl = box_distance(node.left, x, w), dr = box_distance(node.right, x, w);
+        auto first = node.left, second = node.right;
+        if (dr < dl) {
+            std::swap(first, second);
+            std::swap(dl, dr);
+        }
+        if (dl <= top.bound()) search(metric, first, x, w, top, buf);
+        if (dr <= top.bound()) search(metric, second, x, w, top, buf);
+    }
+
+   public:
+    KDTree() = default;
+
+    explicit KDTree(ColumnMatrix<T> const& data) : dim(data.dim()), points(data.rows(), data.dim()) {
+        if (data.rows() == 0) throw std::invalid_argument("KDTree: empty data");
+        rows.resize(data.rows());
+        std::iota(rows.begin(), rows.end(), 0);
+        build(0, static_cast<uint32_t>(rows.size()), data);
+        for (size_t k = 0; k < rows.size(); ++k) {
+            for (size_t i = 0; i < dim; ++i) points(k, i) = data(rows[k], i);
+        }
+    }
+
+    /**
+     * @param metric: a diagonal metric (see metric.hpp).
+     * @return the k nearest (distance, row), nearest first.
+     * */
+    template <class Metric>
+    requires Metric::diagonal
+    std::vector<std::pair<double, uint32_t>> query(Metric const& metric, T const* x, size_t k) const {
+        std::vector<double> w;
+        metric.weights(x, dim, w);
+        TopK top(k);
+        std::vector<double> buf(max_leaf);
+        search(metric, 0, x, w.data(), top, buf.data());
+        auto ret = top.take();
+        for (auto& [d, _] : ret) d = Metric::to_distance(d);
+        return ret;
+    }
+};
+
+}  // namespace rxy
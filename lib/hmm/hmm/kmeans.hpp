@@ -0,0 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace rxy {
+
+/**
+ * @brief k-means (Lloyd, seeded by k-means++) of dim-dimensional points, euclidean.
+ * */
+template <typename T>
+struct KMeans {
+    // the centroids, dim values each
+    std::vector<double> centroids;
+    // the number of points of every centroid, none is empty
+    std::vector<size_t> counts;
+
+    /**
+     * @param points: n points, dim values each, one after another.
+     * @param k: the number of centroids, at most n (fewer if some points are the same).
+     * @param seed: the clustering is reproducible.
+     * */
+    KMeans(T const* points, size_t n, size_t dim, size_t k, size_t max_iter = 20, uint32_t seed = 100) {
+        if (n == 0 || dim == 0) throw std::invalid_argument("KMeans: no point");
+        k = std::clamp<size_t>(k, 1, n);
+        auto dist = [dim](T const* x, double const* c) {
+            double sum = 0;
+            for (size_t i = 0; i < dim; ++i) sum += (x[i] - c[i]) * (x[i] - c[i]);
+            return sum;
+        };
+
+        // k-means++: every next seed is drawn with probability proportional to the squared
+        // distance to the nearest seed so far
+        std::mt19937 gen(seed);
+        centroids.assign(points, points + dim);
+        std::vector<double> nearest(n, std::numeric_limits<double>::infinity());
+        while (centroids.size() < k * dim) {
+            auto last = centroids.data() + centroids.size() - dim;
+            for (size_t p = 0; p < n; ++p) nearest[p] = std::min(nearest[p], dist(points + p * dim, last));
+            // all the points are on a seed
+            if (*std::max_element(nearest.begin(), nearest.end()) == 0) break;
+            std::discrete_distribution<size_t> draw(nearest.begin(), nearest.end());
+            auto p = draw(gen);
+            centroids.insert(centroids.end(), points + p * dim, points + (p + 1) * dim);
+        }
+        k = centroids.size() / dim;
+
+        std::vector<uint32_t> assign(n, UINT32_MAX);
+        for (size_t iter = 0; iter < std::max<size_t>(max_iter, 1); ++iter) {
+            bool changed = false;
+            for (size_t p = 0; p < n; ++p) {
+                uint32_t best = 0;
+                double d = std::numeric_limits<double>::infinity();
+                for (uint32_t c = 0; c < k; ++c) {
+                    auto dc = dist(points + p * dim, centroids.data() + c * dim);
+                    if (dc < d) {
+                        d = dc;
+                        best = c;
+                    }
+                }
+                changed |= assign[p] != best;
+                assign[p] = best;
+            }
+            if (!changed) break;
+            update(points, n, dim, k, assign);
+        }
+        update(points, n, dim, k, assign);
+
+        // the empty clusters are dropped
+        size_t m = 0;
+        for (size_t c = 0; c < counts.size(); ++c) {
+            if (counts[c] == 0) continue;
+            std::copy_n(centroids.begin() + c * dim, dim, centroids.begin() + m * dim);
+            counts[m++] = counts[c];
+        }
+        centroids.resize(m * dim);
+        counts.resize(m);
+    }
+
+    size_t size() const { return counts.size(); }
+
+   private:
+    // the centroids the means of their points, an empty one is left as it is
+    void update(T const* points, size_t n, size_t dim, size_t k, std::vector<uint32_t> const& assign) {
+        std::vector<double> sums(k * dim, 0);
+        counts.assign(k, 0);
+        for (size_t p = 0; p < n; ++p) {
+            ++counts[assign[p]];
+            for (size_t i = 0; i < dim; ++i) sums[assign[p] * dim + i] += points[p * dim + i];
+        }
+        for (size_t c = 0; c < k; ++c) {
+            if (counts[c] == 0) continue;
+            for (size_t i = 0; i < dim; ++i) centroids[c * dim + i] = sums[c * dim + i] / counts[c];
+        }
+    }
+};
+
+}  // namespace rxy
@@ -1,32 +1,255 @@
 #pragma once
 #include <cmath>
+#include <execution>
 #include <functional>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <numeric>
+
+#include "hnsw.hpp"
+#include "kd_tree.hpp"
+#include "kmeans.hpp"
+#include "matrix.hpp"
+#include "metric.hpp"
+#include "vp_tree.hpp"
 
 namespace rxy {
 
-template <typename T>
+/**
+ * @param Metric: the distance policy (see metric.hpp), metric::Function wraps any distance function
+ * for the KNN(topk, function) constructors.
+ * */
+template <typename T, typename Metric = metric::Function<T>>
 requires std::is_arithmetic_v<T>
 class KNN {
+   public:
+    /**
+     * @brief How the nearest neighbours are searched, the result is the same but for hnsw:
+     *  - brute: the distance to every row in one batched pass, then a radix select;
+     *  - kd_tree: for the diagonal metrics (euclidean, weighted and inverse-weighted euclidean);
+     *  - vp_tree: for the distances which are a metric (euclidean, minkowski), not the weighted ones
+     *    which are not symmetric;
+     *  - hnsw: approximate, for the large databases, see HNSWParams for the recall / latency knobs.
+     * The index is built in train.
+     * */
+    enum class Index { brute, kd_tree, vp_tree, hnsw };
+
+    // the label predict returns with the probabilities of predict_prob
+    struct Prediction {
+        int label;
+        std::vector<double> prob;
+    };
+
    private:
+    // predict_prob_batch scores a tile of queries against a block of rows at a time, the block
+    // (ROW_TILE rows of every feature) stays in cache for the queries of the tile
+    static constexpr size_t QUERY_TILE = 8, ROW_TILE = 2048;
+
     size_t N_;
     int label_num;
     int const topk;
-    std::function<double(const std::vector<T>&, const std::vector<T>&)> distance;
-    std::vector<std::vector<T>> data;
+    Metric metric;
+    Index index;
+    HNSWParams hnsw_params;
+    // the training rows, one aligned column per feature
+    ColumnMatrix<T> data;
     std::vector<int> labels;
+    // after compress: the number of training rows every row (a centroid) stands for
+    std::vector<double> weights;
+    std::optional<KDTree<T>> kd_tree;
+    std::optional<VPTree<T>> vp_tree;
+    std::optional<HNSW<T, Metric>> hnsw;
+
+    void build_index() {
+        kd_tree.reset();
+        vp_tree.reset();
+        hnsw.reset();
+        switch (index) {
+            case Index::brute:
+                break;
+            case Index::kd_tree:
+                if constexpr (Metric::diagonal) {
+                    kd_tree.emplace(data);
+                } else {
+                    throw std::invalid_argument("KNN: kd_tree needs a diagonal metric");
+                }
+                break;
+            case Index::vp_tree:
+                if constexpr (Metric::metric) {
+                    std::vector<std::vector<T>> rows;
+                    rows.reserve(N_);
+                    for (size_t i = 0; i < N_; ++i) rows.emplace_back(data.row(i));
+                    vp_tree.emplace(rows, [metric = metric](std::vector<T> const& x, std::vector<T> const& y) {
+                        return metric.distance(x.data(), y.data(), x.size());
+                    });
+                } else {
+                    throw std::invalid_argument("KNN: vp_tree needs a metric distance");
+                }
+                break;
+            case Index::hnsw:
+                hnsw.emplace(data, metric, hnsw_params);
+                break;
+        }
+    }
+
+    /**
+     * @brief the k-th smallest of the scores, by a radix select over their bits mapped to unsigned
+     * integers of the same order: the candidates are bucketed by their offset to the smallest one,
+     * only the bucket holding the k-th is kept. Unlike nth_element it does not degrade on the many
+     * equal scores of integral rsrp values.
+     * */
+    static double kth_smallest(std::vector<double> const& scores, size_t k, std::vector<uint64_t>& keys) {
+        static constexpr int BITS = 11;
+        keys.resize(scores.size());
+        uint64_t lo = UINT64_MAX, hi = 0;
+        for (size_t i = 0; i < scores.size(); ++i) {
+            auto bits = std::bit_cast<uint64_t>(scores[i]);
+            keys[i] = bits & (1ull << 63) ? ~bits : bits | (1ull << 63);
+            lo = std::min(lo, keys[i]);
+            hi = std::max(hi, keys[i]);
+        }
+        size_t n = keys.size();
+        while (lo != hi) {
+            int shift = std::max(0, static_cast<int>(std::bit_width(hi - lo)) - BITS);
+            size_t count[1 << BITS] = {};
+            for (size_t i = 0; i < n; ++i) ++count[(keys[i] - lo) >> shift];
+            size_t bucket = 0;
+            while (k > count[bucket]) k -= count[bucket++];
+            // keep the candidates of the bucket holding the k-th
+            uint64_t base = lo;
+            size_t m = 0;
+            lo = UINT64_MAX, hi = 0;
+            for (size_t i = 0; i < n; ++i) {
+                if (((keys[i] - base) >> shift) == bucket) {
+                    keys[m++] = keys[i];
+                    lo = std::min(lo, keys[i]);
+                    hi = std::max(hi, keys[i]);
+                }
+            }
+            n = m;
+        }
+        return std::bit_cast<double>(lo & (1ull << 63) ? lo & ~(1ull << 63) : ~lo);
+    }
+
+    // the (distance, row) of the k rows of the smallest scores, in row order
+    std::vector<std::pair<double, uint32_t>> nearest(double const* scores, size_t k) const {
+        if (!weights.empty()) return nearest_weighted(scores, k);
+        thread_local std::vector<double> buf;
+        thread_local std::vector<uint64_t> keys;
+        buf.assign(scores, scores + N_);
+        // the k-th smallest score, then the rows below it and the first of the ties
+        auto bound = kth_smallest(buf, k, keys);
+        size_t ties = k - std::count_if(scores, scores + N_, [bound](double d) { return d < bound; });
+        std::vector<std::pair<double, uint32_t>> distances;
+        distances.reserve(k);
+        for (uint32_t i = 0; i < N_; ++i) {
+            if (scores[i] < bound || (scores[i] == bound && ties && ties--)) {
+                distances.emplace_back(Metric::to_distance(scores[i]), i);
+            }
+        }
+        return distances;
+    }
+
+    // the number of neighbours, or the rows the nearest centroids stand for after compress
+    size_t top() const { return weights.empty() ? std::min<size_t>(topk, N_) : topk; }
+
+    // the nearest centroids standing for k training rows, nearest first
+    std::vector<std::pair<double, uint32_t>> nearest_weighted(double const* scores, size_t k) const {
+        thread_local std::vector<double> buf;
+        thread_local std::vector<uint64_t> keys;
+        thread_local std::vector<uint32_t> order;
+        // the candidates are the m nearest, m guessed from the mean weight with some margin: all the
+        // centroids if they do not stand for k rows
+        auto mean = std::accumulate(weights.begin(), weights.end(), 0.) / N_;
+        for (auto m = std::min<size_t>(N_, static_cast<size_t>(1.5 * k / mean) + 1);; m = N_) {
+            buf.assign(scores, scores + N_);
+            auto bound = kth_smallest(buf, m, keys);
+            order.clear();
+            for (uint32_t i = 0; i < N_; ++i) {
+                if (scores[i] <= bound) order.push_back(i);
+            }
+            std::sort(order.begin(), order.end(), [scores](uint32_t a, uint32_t b) {
+                return scores[a] < scores[b] || (scores[a] == scores[b] && a < b);
+            });
+            std::vector<std::pair<double, uint32_t>> distances;
+            double covered = 0;
+            for (auto i : order) {
+                if (covered >= k) break;
+                distances.emplace_back(Metric::to_distance(scores[i]), i);
+                covered += weights[i];
+            }
+            if (covered >= k || m == N_) return distances;
+        }
+    }
+
+    /**
+     * @brief whether the topk nearest rows of a query are brute-force scanned: a tree search visits
+     * more than topk rows anyway, once topk is a sizeable part of the rows (about a tenth on data/)
+     * the linear scan is faster. An approximate index is always used, it was asked for. The
+     * centroids of compress are always scanned, they are few.
+     * */
+    bool brute() const {
+        return index == Index::brute || !weights.empty() ||
+               (index != Index::hnsw && std::min<size_t>(topk, N_) * 16 > N_);
+    }
+
+    /**
+     * @brief the label of the largest weight and the normalized weights, every neighbour weighs the
+     * inverse of its distance (times the rows it stands for, after compress); a neighbour at
+     * distance 0 takes it all.
+     * */
+    Prediction vote(std::vector<std::pair<double, uint32_t>> const& distances) const {
+        Prediction ret{-1, std::vector<double>(label_num, 0)};
+        auto& prob = ret.prob;
+        double S = 0;
+        for (auto [d, row] : distances) {
+            if (d == 0) {
+                std::fill(prob.begin(), prob.end(), 0);
+                prob[labels[row]] = 1;
+                ret.label = labels[row];
+                return ret;
+            } else {
+                double weight = (weights.empty() ? 1.0 : weights[row]) / d;
+                S += weight;
+                prob[labels[row]] += weight;
+            }
+        }
+        auto it = std::max_element(prob.begin(), prob.end());
+        if (*it > 0) ret.label = static_cast<int>(it - prob.begin());
+        for (auto& p : prob) p /= S;
+        return ret;
+    }
 
    public:
-    KNN(int topk, std::function<double(const std::vector<T>&, const std::vector<T>&)> const&
-                      distance_function)
-        : topk(topk), distance(distance_function) {}
-    
-    KNN(int topk, std::function<double(const std::vector<T>&, const std::vector<T>&)> &&
-                      distance_function)
-        : topk(topk), distance(std::move(distance_function)) {}
-    
+    KNN(int topk, Metric metric = {}, Index index = Index::brute, HNSWParams hnsw_params = {})
+        : topk(topk), metric(std::move(metric)), index(index), hnsw_params(hnsw_params) {}
+
+    /**
+     * @return the (distance, row) of the topk nearest rows of the training data: nearest first for
+     * the indices, in row order for the brute-force scan.
+     * */
+    std::vector<std::pair<double, uint32_t>> query(std::vector<T> const& X) const {
+        if (X.size() != data.dim()) throw std::invalid_argument("KNN: wrong dimension");
+        auto k = top();
+        if (brute()) {
+            // reused across the queries of a thread: a fresh buffer of N_ scores costs more page
+            // faults than the scoring itself
+            thread_local std::vector<double> scores;
+            scores.resize(N_);
+            metric.scores(X.data(), data, 0, N_, scores.data());
+            return nearest(scores.data(), k);
+        }
+        if (hnsw) return hnsw->query(X.data(), k, hnsw_params.ef);
+        if (kd_tree) {
+            if constexpr (Metric::diagonal) return kd_tree->query(metric, X.data(), k);
+        }
+        return vp_tree->query(X, k);
+    }
 
     /**
      * @deprecated
@@ -34,10 +257,12 @@ class KNN {
     void train(std::vector<std::vector<T>> const& data, std::vector<int> const& labels) {
         N_ = data.size();
         if (!(data.size() > 0)) throw std::runtime_error("invalid argument");
-        this->data = data;
+        this->data = ColumnMatrix<T>(data);
         if (!(data.size() == labels.size())) throw std::runtime_error("invalid argument");
         this->labels = labels;
+        weights.clear();
         label_num = *std::max_element(labels.begin(), labels.end()) + 1;
+        build_index();
     }
 
     void train(std::vector<std::vector<T>> && data, std::vector<int> && labels) {
@@ -45,74 +270,112 @@ class KNN {
         if (N_ <= 0 || N_ != labels.size()) {
             throw std::invalid_argument("data and labels size must be equal");
         }
-        this->data = std::move(data);
+        this->data = ColumnMatrix<T>(data);
+        data.clear();
         label_num = *std::max_element(labels.begin(), labels.end()) + 1;
         this->labels = std::move(labels);
+        weights.clear();
+        build_index();
     }
 
-    int predict(std::vector<T> const& X) const {
-        std::vector<std::pair<double, int>> distances;
-        distances.reserve(N_);
-        for (size_t i = 0; i < N_; ++i) {
-            distances.emplace_back(distance(X, data[i]), labels[i]);
-        }
-        std::nth_element(distances.begin(), distances.begin() + topk, distances.end(),
-                        [](std::pair<double, int> const& a, std::pair<double, int> const& b) {
-                            return a.first < b.first;
-                        });
-        std::unordered_map<int, double> label_weight;
-        label_weight.reserve(label_num);
-        for (int i = 0; i < topk; ++i) {
-            if (distances[i].first == 0) {
-                return distances[i].second;
-            } else {
-                label_weight[distances[i].second] += 1.0 / distances[i].first;
+    /**
+     * @brief replaces the rows of every label by at most per_label k-means centroids, weighted by
+     * the number of rows they stand for: predict and predict_prob then vote with the nearest
+     * centroids standing for topk rows, a centroid of n rows weighing n / distance. The repeated
+     * noisy measurements of a location compress well.
+     * */
+    void compress(size_t per_label, size_t max_iter = 20) {
+        if (per_label == 0) throw std::invalid_argument("KNN::compress: per_label == 0");
+        if (!weights.empty()) throw std::runtime_error("KNN::compress: already compressed");
+        auto dim = data.dim();
+        std::vector<std::vector<uint32_t>> rows(label_num);
+        for (uint32_t r = 0; r < N_; ++r) rows[labels[r]].push_back(r);
+        std::vector<std::vector<T>> centroids;
+        std::vector<int> centroid_labels;
+        std::vector<T> points;
+        for (int label = 0; label < label_num; ++label) {
+            if (rows[label].empty()) continue;
+            points.clear();
+            for (auto r : rows[label]) {
+                for (size_t i = 0; i < dim; ++i) points.push_back(data(r, i));
             }
-        }
-        double _max = std::numeric_limits<double>::min();
-        int _max_label = -1;
-        for (auto [label, weight] : label_weight) {
-            if (weight > _max) {
-                _max = weight;
-                _max_label = label;
+            KMeans<T> kmeans(points.data(), rows[label].size(), dim, per_label, max_iter);
+            for (size_t c = 0; c < kmeans.size(); ++c) {
+                auto first = kmeans.centroids.begin() + c * dim;
+                centroids.emplace_back(first, first + dim);
+                centroid_labels.push_back(label);
+                weights.push_back(static_cast<double>(kmeans.counts[c]));
             }
         }
-        if (_max_label == -1) {
-            throw std::runtime_error("KNN::predict: no label found");
-        }
-        return _max_label;
+        N_ = centroids.size();
+        data = ColumnMatrix<T>(centroids);
+        labels = std::move(centroid_labels);
+        build_index();
     }
 
-    std::vector<double> predict_prob(std::vector<T> const & X) const {
-        std::vector<std::pair<double, int>> distances;
-        distances.reserve(N_);
-        for (size_t i = 0; i < N_; ++i) {
-            distances.emplace_back(distance(X, data[i]), labels[i]);
-        }
+    // the number of training rows (or centroids, after compress)
+    size_t size() const { return N_; }
 
-        std::nth_element(distances.begin(), distances.begin() + topk, distances.end(),
-                        [](std::pair<double, int> const& a, std::pair<double, int> const& b) {
-                            return a.first < b.first;
-                        });
+    // the bytes of the training rows, their labels and weights
+    size_t memory() const {
+        return data.memory() + labels.capacity() * sizeof(int) + weights.capacity() * sizeof(double);
+    }
 
-        std::vector<double> prob(label_num, 0);
-        std::unordered_map<int, double> label_weight;
-        label_weight.reserve(topk);
-        double S = 0;
-        for (int i = 0; i < topk; ++i) {
-            if (distances[i].first == 0) {
-                prob[distances[i].second] = 1;
-                return prob;
-            } else {
-                double weight = 1.0 / distances[i].first;
-                S += weight;
-                label_weight[distances[i].second] += weight;
-            }
+    int predict(std::vector<T> const& X) const {
+        auto label = vote(query(X)).label;
+        if (label == -1) throw std::runtime_error("KNN::predict: no label found");
+        return label;
+    }
+
+    std::vector<double> predict_prob(std::vector<T> const & X) const { return vote(query(X)).prob; }
+
+    /**
+     * @brief predict and predict_prob of every query, in one pass. The brute-force scan is tiled:
+     * QUERY_TILE queries are scored against ROW_TILE rows at a time, the tiles of queries run in
+     * parallel.
+     * */
+    std::vector<Prediction> predict_prob_batch(std::vector<std::vector<T>> const& queries) const {
+        for (auto& X : queries) {
+            if (X.size() != data.dim()) throw std::invalid_argument("KNN: wrong dimension");
         }
-        for (auto [label, weight] : label_weight) {
-            prob[label] = weight / S;
+        std::vector<Prediction> ret(queries.size());
+        if (!brute()) {
+            std::vector<size_t> ids(queries.size());
+            std::iota(ids.begin(), ids.end(), 0);
+            std::for_each(std::execution::par, ids.begin(), ids.end(),
+                          [this, &queries, &ret](size_t q) { ret[q] = vote(query(queries[q])); });
+            return ret;
         }
-        return prob;
+        auto k = top();
+        std::vector<size_t> tiles((queries.size() + QUERY_TILE - 1) / QUERY_TILE);
+        std::iota(tiles.begin(), tiles.end(), 0);
+        std::for_each(std::execution::par, tiles.begin(), tiles.end(), [this, &queries, &ret, k](size_t tile) {
+            auto first = tile * QUERY_TILE, last = std::min(first + QUERY_TILE, queries.size());
+            // the scores of the queries of the tile, N_ each
+            thread_local std::vector<double> scores;
+            scores.resize(QUERY_TILE * N_);
+            // the weights of a diagonal metric only depend on the query: computed once, not per row tile
+            thread_local std::vector<std::vector<double>> query_weights;
+            if constexpr (Metric::diagonal) {
+                query_weights.resize(QUERY_TILE);
+                for (auto q = first; q < last; ++q) {
+                    metric.weights(queries[q].data(), data.dim(), query_weights[q - first]);
+                }
+            }
+            for (size_t begin = 0; begin < N_; begin += ROW_TILE) {
+                auto end = std::min(begin + ROW_TILE, N_);
+                for (auto q = first; q < last; ++q) {
+                    auto out = scores.data() + (q - first) * N_ + begin;
+                    if constexpr (Metric::diagonal) {
+                        metric.scores(queries[q].data(), query_weights[q - first].data(), data, begin, end, out);
+                    } else {
+                        metric.scores(queries[q].data(), data, begin, end, out);
+                    }
+                }
+            }
+            for (auto q = first; q < last; ++q) ret[q] = vote(nearest(scores.data() + (q - first) * N_, k));
+        });
+        return ret;
     }
 
     static inline double distance_euclidean(std::vector<T> const& x, std::vector<T> const& y) {
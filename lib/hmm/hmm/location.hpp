@@ -1,6 +1,7 @@
 #pragma once
 #include <cmath>
 #include <configure.hpp>
+#include <cstdint>
 #include <functional>
 #include <limits>
 #include <memory>
@@ -110,21 +111,38 @@ inline std::ostream& operator<<(std::ostream& os, Point const& p) {
     return os;
 }
 
+/**
+ * @brief The identity of a location, the key of the containers of the hmm library: the index of
+ * its ext cell and the id of its coarse location. Trivially copyable, compared and hashed without
+ * touching the Location object.
+ * */
+struct LocKey {
+    // the ext cell of a coarse location
+    static constexpr uint32_t NO_EXT = std::numeric_limits<uint32_t>::max();
+
+    uint32_t ext = NO_EXT;
+    int32_t id = -1;
+
+    constexpr bool operator==(LocKey const&) const = default;
+};
+
 struct Location {
     int id;
     Point point;
+    // the ext cell, NO_EXT for a coarse location (see ExtLocation)
+    uint32_t ext = LocKey::NO_EXT;
 
     // constexpr Location(int id, Point::value_type x, Point::value_type y) : id(id), point(x, y) {}
     constexpr Location(int id, Point const& point) : id(id), point(point) {}
     constexpr Location(int id, Point&& point) : id(id), point(std::move(point)) {}
+    constexpr Location(int id, uint32_t ext, Point const& point) : id(id), point(point), ext(ext) {}
     virtual ~Location() = default;
 
-    virtual size_t get_hash() const { return id; }
+    constexpr LocKey key() const { return {ext, id}; }
 
-    virtual bool operator==(Location const & rhs) const {
-        return id == rhs.id;
-    }
-    
+    size_t get_hash() const;
+
+    bool operator==(Location const& rhs) const { return key() == rhs.key(); }
 };
 
 inline bool operator==(LocationPtr lhs, LocationPtr rhs) {
@@ -150,6 +168,17 @@ struct hash<rxy::PointPtr> {
     }
 };
 
+template <>
+struct hash<rxy::LocKey> {
+    size_t operator()(rxy::LocKey const& key) const {
+        // splitmix64 of the two halves: the ext indices of a grid are dense, spread them
+        uint64_t x = (uint64_t(key.ext) << 32) | uint32_t(key.id);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return static_cast<size_t>(x ^ (x >> 31));
+    }
+};
+
 template <>
 struct hash<rxy::Location> {
     size_t operator()(rxy::Location const& loc) const { return loc.get_hash(); }
@@ -162,4 +191,6 @@ struct hash<rxy::LocationPtr> {
     }
 };
 
-}  // namespace std
\ No newline at end of file
+}  // namespace std
+
+inline size_t rxy::Location::get_hash() const { return std::hash<LocKey>()(key()); }
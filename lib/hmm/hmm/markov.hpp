@@ -1,23 +1,65 @@
 #pragma once
 #include "location.hpp"
 #include "sensation.hpp"
+#include <stdexcept>
+#include <unordered_map>
 #include <unordered_set>
 #include "probability.hpp"
+#include "state_index.hpp"
+#include "transition.hpp"
 
 namespace rxy {
 
 class Markov {
 protected:
     Sensation const sense;
-    std::unordered_map<LocationPtr, std::unordered_map<LocationPtr, Prob>> _tran_prob;
+    // the states the transition matrix is indexed by
+    StateIndexPtr index;
+    SparseTransition _tran_prob;
 
 public:
     Markov(Sensation const& sense) : sense(sense) {}
     Markov(Sensation && sense) : sense(std::move(sense)) {}
+    virtual ~Markov() = default;
 
+    // the explicitly stored transitions
     auto & get_tran_prob() const { return _tran_prob; }
+
+    // the kernel HMM runs on, the explicit CSR unless a subclass provides a faster one
+    virtual Transition const& transition() const { return _tran_prob; }
+
+    auto & get_state_index() const { return index; }
+
+    // P(src -> dst)
+    virtual Prob prob(LocationPtr const& src, LocationPtr const& dst) const {
+        return {_tran_prob(index->at(dst), index->at(src)), true};
+    }
 };
 
 using MarkovPtr = std::shared_ptr<Markov>;
 
+/**
+ * @brief The transition of a markov over the given StateIndex: markovs built on the same index are
+ * consumed as they are, the others are permuted once per markov.
+ * */
+class TransitionResolver {
+   private:
+    StateIndexPtr index;
+    std::unordered_map<Markov const*, PermutedTransition> permuted;
+
+   public:
+    explicit TransitionResolver(StateIndexPtr index) : index(std::move(index)) {}
+
+    Transition const& operator()(Markov const& markov) {
+        auto& markov_index = markov.get_state_index();
+        if (markov_index == index) return markov.transition();
+        if (!markov_index) throw std::runtime_error("markov without state index");
+        auto it = permuted.find(&markov);
+        if (it == permuted.end()) {
+            it = permuted.try_emplace(&markov, markov.transition(), *markov_index, *index).first;
+        }
+        return it->second;
+    }
+};
+
 }
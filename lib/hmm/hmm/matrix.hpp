@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+namespace rxy {
+
+// allocator of cache line aligned buffers, for the vector kernels
+template <typename T, size_t Align = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Align>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(AlignedAllocator<U, Align> const&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align))); }
+
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(Align)); }
+
+    friend bool operator==(AlignedAllocator const&, AlignedAllocator const&) { return true; }
+};
+
+/**
+ * @brief Dense rows x dim matrix in one aligned buffer, stored by column: the values of a feature
+ * for consecutive rows are contiguous, so that the kernels scoring one query against many rows
+ * vectorize over the rows. Every column is padded to a multiple of 16 rows.
+ * */
+template <typename T>
+class ColumnMatrix {
+   private:
+    size_t n = 0, d = 0, stride_ = 0;
+    std::vector<T, AlignedAllocator<T>> values;
+
+   public:
+    ColumnMatrix() = default;
+
+    ColumnMatrix(size_t rows, size_t dim)
+        : n(rows), d(dim), stride_((rows + 15) / 16 * 16), values(stride_ * dim, T{}) {}
+
+    // from row vectors of the same size
+    explicit ColumnMatrix(std::vector<std::vector<T>> const& data)
+        : ColumnMatrix(data.size(), data.empty() ? 0 : data.front().size()) {
+        for (size_t r = 0; r < n; ++r) {
+            if (data[r].size() != d) throw std::invalid_argument("ColumnMatrix: rows of different sizes");
+            for (size_t i = 0; i < d; ++i) (*this)(r, i) = data[r][i];
+        }
+    }
+
+    size_t rows() const { return n; }
+
+    size_t dim() const { return d; }
+
+    // distance between two consecutive columns
+    size_t stride() const { return stride_; }
+
+    T* column(size_t i) { return values.data() + i * stride_; }
+
+    T const* column(size_t i) const { return values.data() + i * stride_; }
+
+    T& operator()(size_t r, size_t i) { return values[i * stride_ + r]; }
+
+    T operator()(size_t r, size_t i) const { return values[i * stride_ + r]; }
+
+    std::vector<T> row(size_t r) const {
+        std::vector<T> ret(d);
+        for (size_t i = 0; i < d; ++i) ret[i] = (*this)(r, i);
+        return ret;
+    }
+
+    size_t memory() const { return values.capacity() * sizeof(T); }
+};
+
+}  // namespace rxy
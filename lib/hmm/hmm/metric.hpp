@@ -0,0 +1,162 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "distance_simd.hpp"
+#include "matrix.hpp"
+
+/**
+ * @brief Distance policies of KNN, chosen at compile time. A policy provides:
+ *  - distance(x, y, dim): the distance between two rows;
+ *  - scores(x, m, begin, end, out): a monotone transform of the distances from x to the rows
+ *    [begin, end) of m, in one pass, and to_distance(score) which inverts it;
+ *  - diagonal: whether the distance is sqrt(sum_i w_i * (x_i - y_i)^2), the weights w only
+ *    depending on the query x (given by weights(x, w)), as the kd_tree requires;
+ *  - metric: whether the distance is a metric (symmetric, with the triangle inequality), as the
+ *    vp_tree requires.
+ * */
+namespace rxy::metric {
+
+/**
+ * @brief sqrt(sum_i W::weight(x_i) * (x_i - y_i)^2), scored by its square.
+ * */
+template <class W>
+struct Diagonal {
+    static constexpr bool diagonal = true;
+
+    template <typename T>
+    void weights(T const* x, size_t dim, std::vector<double>& w) const {
+        w.resize(dim);
+        for (size_t i = 0; i < dim; ++i) w[i] = W::weight(static_cast<double>(x[i]));
+    }
+
+    template <typename T>
+    double distance(T const* x, T const* y, size_t dim) const {
+        double sum = 0;
+        for (size_t i = 0; i < dim; ++i) {
+            double d = static_cast<double>(x[i]) - y[i];
+            sum += W::weight(static_cast<double>(x[i])) * d * d;
+        }
+        return std::sqrt(sum);
+    }
+
+    template <typename T>
+    void scores(T const* x, ColumnMatrix<T> const& m, size_t begin, size_t end, double* out) const {
+        thread_local std::vector<double> w;
+        weights(x, m.dim(), w);
+        scores(x, w.data(), m, begin, end, out);
+    }
+
+    // with the weights of x already computed
+    template <typename T>
+    void scores(T const* x, double const* w, ColumnMatrix<T> const& m, size_t begin, size_t end, double* out) const {
+        if constexpr (std::is_same_v<T, double>) {
+            simd::weighted_sq_distances(x, w, m.column(0), m.stride(), m.dim(), begin, end, out);
+        } else {
+            for (size_t r = begin; r < end; ++r) {
+                double sum = 0;
+                for (size_t i = 0; i < m.dim(); ++i) {
+                    double d = static_cast<double>(x[i]) - m(r, i);
+                    sum += w[i] * d * d;
+                }
+                out[r - begin] = sum;
+            }
+        }
+    }
+
+    static double to_distance(double score) { return std::sqrt(score); }
+};
+
+struct Euclidean : Diagonal<Euclidean> {
+    static constexpr bool metric = true;
+
+    static double weight(double) { return 1; }
+};
+
+// KNN::distance_weighted_euc: the differences scaled by the query
+struct WeightedEuclidean : Diagonal<WeightedEuclidean> {
+    // weighted by the query only: not symmetric
+    static constexpr bool metric = false;
+
+    static double weight(double x) { return x * x; }
+};
+
+// KNN::distance_inv_weighted_euc: the relative differences to the query
+struct InvWeightedEuclidean : Diagonal<InvWeightedEuclidean> {
+    static constexpr bool metric = false;
+
+    static double weight(double x) { return 1. / (x * x); }
+};
+
+/**
+ * @brief (sum_i |x_i - y_i|^P)^(1/P), scored by its P-th power.
+ * */
+template <int P>
+requires(P >= 1)
+struct Minkowski {
+    static constexpr bool diagonal = false;
+    static constexpr bool metric = true;
+
+    template <typename T>
+    double distance(T const* x, T const* y, size_t dim) const {
+        double sum = 0;
+        for (size_t i = 0; i < dim; ++i) sum += std::pow(std::fabs(static_cast<double>(x[i]) - y[i]), P);
+        return to_distance(sum);
+    }
+
+    template <typename T>
+    void scores(T const* x, ColumnMatrix<T> const& m, size_t begin, size_t end, double* out) const {
+        if constexpr (std::is_same_v<T, double>) {
+            simd::pow_distances(x, P, m.column(0), m.stride(), m.dim(), begin, end, out);
+        } else {
+            for (size_t r = begin; r < end; ++r) {
+                double sum = 0;
+                for (size_t i = 0; i < m.dim(); ++i) sum += std::pow(std::fabs(static_cast<double>(x[i]) - m(r, i)), P);
+                out[r - begin] = sum;
+            }
+        }
+    }
+
+    static double to_distance(double score) { return P == 1 ? score : std::pow(score, 1. / P); }
+};
+
+/**
+ * @brief Any distance function over row vectors, called row by row: the compatibility policy of the
+ * KNN(topk, function) constructors.
+ * */
+template <typename T>
+class Function {
+   private:
+    std::function<double(std::vector<T> const&, std::vector<T> const&)> f;
+
+   public:
+    static constexpr bool diagonal = false;
+    // nothing is known of the function
+    static constexpr bool metric = false;
+
+    Function() = default;
+
+    template <typename F>
+    requires std::is_invocable_r_v<double, F, std::vector<T> const&, std::vector<T> const&>
+    Function(F&& f) : f(std::forward<F>(f)) {}
+
+    double distance(T const* x, T const* y, size_t dim) const {
+        return f(std::vector<T>(x, x + dim), std::vector<T>(y, y + dim));
+    }
+
+    void scores(T const* x, ColumnMatrix<T> const& m, size_t begin, size_t end, double* out) const {
+        std::vector<T> q(x, x + m.dim()), y(m.dim());
+        for (size_t r = begin; r < end; ++r) {
+            for (size_t i = 0; i < m.dim(); ++i) y[i] = m(r, i);
+            out[r - begin] = f(q, y);
+        }
+    }
+
+    static double to_distance(double score) { return score; }
+};
+
+}  // namespace rxy::metric
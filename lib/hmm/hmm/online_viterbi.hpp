@@ -0,0 +1,88 @@
+#pragma once
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "emission_prob.hpp"
+#include "location.hpp"
+#include "markov.hpp"
+#include "probability.hpp"
+#include "state_index.hpp"
+#include "transition.hpp"
+
+namespace rxy {
+
+/**
+ * @brief Incremental viterbi decoder for live positioning: observations are pushed one time step
+ * at a time. Every push returns the current best state immediately, plus the part of the path that
+ * has become fixed:
+ *  - convergence point: all the surviving paths share their prefix up to some time, which is then
+ *    exactly the batch viterbi path;
+ *  - fixed lag: the states older than `lag` steps are committed from the current best path.
+ * Only the backpointers of the uncommitted steps are kept, so memory is O(N * lag) instead of O(N * T).
+ * */
+class OnlineViterbi {
+   public:
+    using value_type = Prob::value_type;
+
+    struct Output {
+        // best state of the newest time step, given the observations so far
+        LocationPtr best;
+        // time step of committed.front()
+        size_t committed_from;
+        // the newly committed states, in time order
+        std::vector<LocationPtr> committed;
+    };
+
+   private:
+    StateIndexPtr index;
+    std::vector<value_type> init;
+    size_t lag;
+
+    // number of pushed time steps
+    size_t T = 0;
+    // first time step not committed yet
+    size_t frontier = 0;
+    std::vector<value_type> dp, cur, emission;
+    // psi[k]: backpointers from time frontier + k + 1 to time frontier + k
+    std::deque<std::vector<uint32_t>> psi;
+    // best[k]: the argmax of time frontier + k, where a path with no predecessor resumes
+    std::deque<uint32_t> best;
+    // the rows of the committed steps, reused by the next pushes
+    std::vector<std::vector<uint32_t>> spare;
+    TransitionResolver resolve;
+    // scratch of the convergence search
+    std::vector<uint32_t> live, prev_live;
+    std::vector<size_t> stamp;
+    size_t stamp_id = 0;
+
+    uint32_t argmax() const;
+    // states from time frontier up to time `to` of the path ending in `l` at time T - 1
+    std::vector<uint32_t> backtrack(uint32_t l, size_t to) const;
+    void commit(std::vector<uint32_t> const& states, Output& out);
+    // drops the first n steps of psi, their rows go to spare
+    void release(size_t n);
+    void re_init(Output& out);
+
+   public:
+    /**
+     * @param init: the initial probability of each location.
+     * @param lag: the maximum number of uncommitted steps, at least 1.
+     * */
+    OnlineViterbi(StateIndexPtr index, std::unordered_map<LocKey, Prob> const& init, size_t lag);
+
+    /**
+     * @param markov: the transition from the previous time step, ignored for the first one.
+     * @param emission: the rsrp emission probability P(X|L) of the new time step.
+     * */
+    Output push(MarkovPtr const& markov, EmissionProb const& emission);
+
+    // commit all the remaining steps along the current best path, this ends the trace
+    Output flush();
+
+    size_t size() const { return T; }
+
+    size_t committed_size() const { return frontier; }
+};
+
+}  // namespace rxy
@@ -0,0 +1,52 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "probability.hpp"
+
+/**
+ * @brief Batched Prob arithmetic over contiguous log-space arrays, the building blocks of the
+ * decoders. The instruction set is chosen at run time from the cpu: AVX-512, AVX2 + FMA, or a
+ * scalar fallback; the results only differ in the last bits.
+ * */
+namespace rxy::simd {
+
+using value_type = Prob::value_type;
+
+// name of the instruction set in use: "avx512", "avx2" or "scalar"
+char const* isa();
+
+// log sum_i exp(x[i]), Prob::ZERO if n == 0
+value_type log_sum_exp(value_type const* x, size_t n);
+
+// log sum_i exp(a[idx[i]] + b[i])
+value_type log_sum_exp(value_type const* a, uint32_t const* idx, value_type const* b, size_t n);
+
+/**
+ * @brief max_i a[idx[i]] + b[i] and the first argmax idx[i], (Prob::ZERO, Transition::NIL) if every term is ZERO.
+ * */
+std::pair<value_type, uint32_t> max_plus(value_type const* a, uint32_t const* idx, value_type const* b, size_t n);
+
+// the log normalization term of log_nd_pdf, sigma > 0
+inline value_type log_nd_norm(value_type sigma) { return INV_SQRT_PI_LOG - std::log(sigma); }
+
+/**
+ * @brief out[i] = log_nd_pdf(x[i], mu[i], sigma[i]), the parameters given as inv_sigma = 1 / sigma
+ * and log_norm = log_nd_norm(sigma).
+ * */
+void log_nd_pdf(value_type const* x, value_type const* mu, value_type const* inv_sigma,
+                value_type const* log_norm, value_type* out, size_t n);
+
+// out[i] = log_nd_pdf(x[i]), with ND_MU and ND_SIGMA
+void log_nd_pdf(value_type const* x, value_type* out, size_t n);
+
+/**
+ * @brief out[i] += log_nd_pdf(x, mu[i], sigma[i]): one observation scored against n gaussians, with
+ * the parameters of log_nd_pdf above. inv_sigma[i] = log_norm[i] = 0 adds nothing.
+ * */
+void add_log_nd_pdf(value_type x, value_type const* mu, value_type const* inv_sigma, value_type const* log_norm,
+                    value_type* out, size_t n);
+
+}  // namespace rxy::simd
@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
 #include <configure.hpp>
 #include <iostream>
@@ -33,7 +34,9 @@ struct Prob {
         if (this->prob == -std::numeric_limits<value_type>::infinity()) {
             this->prob = rhs.prob;
         } else if (rhs.prob != -std::numeric_limits<value_type>::infinity()) {
-            this->prob = std::log1p(std::exp(this->prob) + std::exp(rhs.prob) - 1);
+            // log(e^a + e^b) = max + log(1 + e^(min - max)), exact however small a and b are
+            auto [lo, hi] = std::minmax(this->prob, rhs.prob);
+            this->prob = hi + std::log1p(std::exp(lo - hi));
         }
         return *this;
     }
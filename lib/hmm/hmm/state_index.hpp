@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "location.hpp"
+
+namespace rxy {
+
+/**
+ * @brief A bijection between the states (locations) of an HMM and the dense index range [0, N).
+ * The hot loops (viterbi, markov construction, ...) run over contiguous arrays indexed by it, the
+ * LocationPtr is only resolved at the boundary. A state is identified by its LocKey: the lookups
+ * neither follow the pointer nor call into the Location.
+ * */
+class StateIndex {
+   private:
+    std::vector<LocationPtr> states;
+    std::vector<LocKey> keys;
+    std::unordered_map<LocKey, uint32_t> index;
+
+   public:
+    StateIndex() = default;
+
+    template <typename Container>
+    explicit StateIndex(Container const& locs) {
+        states.reserve(locs.size());
+        keys.reserve(locs.size());
+        index.reserve(locs.size());
+        for (auto&& loc : locs) {
+            if (index.emplace(loc->key(), static_cast<uint32_t>(states.size())).second) {
+                states.emplace_back(loc);
+                keys.push_back(loc->key());
+            }
+        }
+    }
+
+    size_t size() const { return states.size(); }
+
+    LocationPtr const& operator[](uint32_t i) const { return states[i]; }
+
+    LocKey key(uint32_t i) const { return keys[i]; }
+
+    uint32_t at(LocKey key) const { return index.at(key); }
+
+    uint32_t at(LocationPtr const& loc) const { return index.at(loc->key()); }
+
+    bool contains(LocKey key) const { return index.find(key) != index.end(); }
+
+    bool contains(LocationPtr const& loc) const { return contains(loc->key()); }
+
+    auto begin() const { return states.begin(); }
+
+    auto end() const { return states.end(); }
+};
+
+using StateIndexPtr = std::shared_ptr<StateIndex const>;
+
+}  // namespace rxy
@@ -0,0 +1,166 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "probability.hpp"
+#include "state_index.hpp"
+
+namespace rxy {
+
+/**
+ * @brief Transition kernel of an HMM over dense state indices [0, N).
+ * All the probabilities are in log space, i.e. the `prob` member of Prob. The markovs share their
+ * transition across the decodes, so the products hold no state: they may run concurrently.
+ * */
+class Transition {
+   public:
+    using value_type = Prob::value_type;
+    // no predecessor
+    static constexpr uint32_t NIL = std::numeric_limits<uint32_t>::max();
+
+    virtual ~Transition() = default;
+
+    virtual size_t size() const = 0;
+
+    /**
+     * @brief max-product step of viterbi:
+     * cur[l] = max_{l'} prev[l'] * P(l' -> l), psi[l] = argmax_{l'}.
+     * psi[l] is NIL if no predecessor has a non-zero probability.
+     * */
+    virtual void max_product(value_type const* prev, value_type* cur, uint32_t* psi) const = 0;
+
+    /**
+     * @brief max-product restricted to the active sources, prev being ZERO for all the others.
+     * cur must be ZERO and psi NIL on entry; only the destinations reachable from an active source
+     * are written, each of them is appended once to `touched`. The default falls back to the full
+     * max_product, the sparse kernels scatter from the active sources only so that the cost scales
+     * with the beam instead of N.
+     * */
+    virtual void max_product_sparse(value_type const* prev, std::vector<uint32_t> const& active,
+                                    value_type* cur, uint32_t* psi,
+                                    std::vector<uint32_t>& touched) const;
+
+    /**
+     * @brief sum-product step of the forward algorithm: cur[l] = sum_{l'} prev[l'] * P(l' -> l).
+     * */
+    virtual void sum_product(value_type const* prev, value_type* cur) const = 0;
+
+    /**
+     * @brief sum-product step of the backward algorithm, over the transposed matrix:
+     * cur[l'] = sum_{l} P(l' -> l) * next[l].
+     * */
+    virtual void sum_product_transposed(value_type const* next, value_type* cur) const = 0;
+};
+
+/**
+ * @brief Sparse transition matrix in CSR form, indexed by destination: the row of dst only holds
+ * the sources src with P(src -> dst) > 0 (sorted by src), so that the max-product only touches the
+ * real predecessors.
+ * */
+class SparseTransition : public Transition {
+   public:
+    // the arrays of the matrix, see the members
+    struct Arrays {
+        std::span<size_t const> row_ptr;
+        std::span<uint32_t const> src;
+        std::span<value_type const> log_prob;
+        std::span<size_t const> col_ptr;
+        std::span<uint32_t const> dst;
+        std::span<value_type const> col_log_prob;
+    };
+
+   private:
+    size_t N = 0;
+    // keeps the arrays alive: vectors of their own, or a mapped file; shared by the copies
+    std::shared_ptr<void const> storage;
+    std::span<size_t const> row_ptr;
+    std::span<uint32_t const> src;
+    std::span<value_type const> log_prob;
+    // the same matrix indexed by source (CSC), for the kernels scattering from the sources
+    std::span<size_t const> col_ptr;
+    std::span<uint32_t const> dst;
+    std::span<value_type const> col_log_prob;
+    std::vector<uint32_t> rows;
+
+   public:
+    SparseTransition() = default;
+
+    /**
+     * @param out_edges: out_edges[src] = { (dst, log P(src -> dst)), ... }, size N.
+     * */
+    SparseTransition(size_t N, std::vector<std::vector<std::pair<uint32_t, value_type>>> const& out_edges);
+
+    /**
+     * @brief over arrays owned by storage (e.g. a mapped file), without copying them; they are
+     * checked to be consistent with N: sizes, monotone pointers ending at nnz, indices < N.
+     * */
+    SparseTransition(size_t N, Arrays const& arrays, std::shared_ptr<void const> storage);
+
+    Arrays arrays() const { return {row_ptr, src, log_prob, col_ptr, dst, col_log_prob}; }
+
+    size_t size() const override { return N; }
+
+    // number of non-zero transitions
+    size_t nnz() const { return src.size(); }
+
+    std::span<uint32_t const> row_src(uint32_t dst) const {
+        return {src.data() + row_ptr[dst], src.data() + row_ptr[dst + 1]};
+    }
+
+    std::span<value_type const> row_prob(uint32_t dst) const {
+        return {log_prob.data() + row_ptr[dst], log_prob.data() + row_ptr[dst + 1]};
+    }
+
+    std::span<uint32_t const> col_dst(uint32_t s) const {
+        return {dst.data() + col_ptr[s], dst.data() + col_ptr[s + 1]};
+    }
+
+    std::span<value_type const> col_prob(uint32_t s) const {
+        return {col_log_prob.data() + col_ptr[s], col_log_prob.data() + col_ptr[s + 1]};
+    }
+
+    // log P(src -> dst), Prob::ZERO if not stored
+    value_type operator()(uint32_t dst, uint32_t src) const;
+
+    void max_product(value_type const* prev, value_type* cur, uint32_t* psi) const override;
+
+    void max_product_sparse(value_type const* prev, std::vector<uint32_t> const& active,
+                            value_type* cur, uint32_t* psi,
+                            std::vector<uint32_t>& touched) const override;
+
+    void sum_product(value_type const* prev, value_type* cur) const override;
+
+    void sum_product_transposed(value_type const* next, value_type* cur) const override;
+};
+
+/**
+ * @brief Adapts a transition indexed by another StateIndex to the given one, by gathering the
+ * scores into the inner order and scattering the results back.
+ * */
+class PermutedTransition : public Transition {
+   private:
+    Transition const& inner;
+    // index -> inner index
+    std::vector<uint32_t> to_inner;
+    // inner index -> index, NIL if not a state of the index
+    std::vector<uint32_t> from_inner;
+    // index order -> inner order, in a buffer of the call: the inner one may be permuted too
+    std::vector<value_type> gather(value_type const* in) const;
+
+   public:
+    PermutedTransition(Transition const& inner, StateIndex const& inner_index, StateIndex const& index);
+
+    size_t size() const override { return to_inner.size(); }
+
+    void max_product(value_type const* prev, value_type* cur, uint32_t* psi) const override;
+
+    void sum_product(value_type const* prev, value_type* cur) const override;
+
+    void sum_product_transposed(value_type const* next, value_type* cur) const override;
+};
+
+}  // namespace rxy
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "probability.hpp"
+#include "transition.hpp"
+
+namespace rxy {
+
+/**
+ * @brief Pruning of the viterbi search: after every step only the `width` best states, and those
+ * within `threshold` (in log probability) of the best one, are kept. The default keeps everything.
+ * */
+struct Beam {
+    // 0: unbounded
+    size_t width = 0;
+    // >= 0
+    Prob::value_type threshold = std::numeric_limits<Prob::value_type>::infinity();
+
+    bool enabled() const {
+        return width != 0 || threshold != std::numeric_limits<Prob::value_type>::infinity();
+    }
+};
+
+/**
+ * @brief Viterbi over dense state indices [0, N), see HMM::viterbi for the LocationPtr adapter.
+ * @param transitions: transitions[t - 1] is the transition from time t - 1 to time t, size T - 1.
+ * @param init: log initial probability of each state, size N.
+ * @param emissions: log emission probability, row-major T x N: emissions[t * N + l].
+ * @return the most probable state index at each time step.
+ * */
+std::vector<uint32_t> viterbi(std::vector<Transition const*> const& transitions,
+                              std::vector<Prob::value_type> const& init,
+                              std::vector<Prob::value_type> const& emissions);
+
+/**
+ * @brief Beam-pruned viterbi: the same recursion, but only the states of the beam are expanded,
+ * through Transition::max_product_sparse, and only they are stored. The cost of a step scales with
+ * the beam and the fan-out of the transition instead of N. Not exact: the best path can be pruned.
+ * */
+std::vector<uint32_t> viterbi(std::vector<Transition const*> const& transitions,
+                              std::vector<Prob::value_type> const& init,
+                              std::vector<Prob::value_type> const& emissions, Beam const& beam);
+
+}  // namespace rxy
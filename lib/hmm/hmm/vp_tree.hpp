@@ -0,0 +1,91 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "kd_tree.hpp"
+
+namespace rxy {
+
+/**
+ * @brief Vantage-point tree over the rows of a dataset, for any distance which is a metric
+ * (symmetric, with the triangle inequality). Every node splits its rows by their distance to a
+ * vantage point at the median mu; a query only enters the side whose shell can hold a point nearer
+ * than the current k-th neighbour, so the search is exact.
+ * */
+template <typename T>
+class VPTree {
+   public:
+    using Distance = std::function<double(std::vector<T> const&, std::vector<T> const&)>;
+
+   private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Node {
+        uint32_t row;
+        std::vector<T> point;
+        double mu = 0;
+        // the rows nearer than mu, the others
+        uint32_t inside = NONE, outside = NONE;
+    };
+
+    Distance distance;
+    std::vector<Node> nodes;
+
+    uint32_t build(std::vector<std::vector<T>> const& data, std::vector<std::pair<double, uint32_t>>& items,
+                   size_t begin, size_t end) {
+        if (begin == end) return NONE;
+        auto id = static_cast<uint32_t>(nodes.size());
+        // the first row is the vantage point, the others are ordered by their distance to it
+        auto& vp = data[items[begin].second];
+        nodes.push_back({items[begin].second, vp});
+        ++begin;
+        if (begin == end) return id;
+        for (auto i = begin; i < end; ++i) items[i].first = distance(vp, data[items[i].second]);
+        auto mid = begin + (end - begin) / 2;
+        std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end);
+        nodes[id].mu = items[mid].first;
+        auto inside = build(data, items, begin, mid);
+        auto outside = build(data, items, mid, end);
+        nodes[id].inside = inside;
+        nodes[id].outside = outside;
+        return id;
+    }
+
+    void search(uint32_t id, std::vector<T> const& x, TopK& top) const {
+        if (id == NONE) return;
+        auto& node = nodes[id];
+        double d = distance(x, node.point);
+        top.push(d, node.row);
+        if (d < node.mu) {
+            if (d - top.bound() <= node.mu) search(node.inside, x, top);
+            if (d + top.bound() >= node.mu) search(node.outside, x, top);
+        } else {
+            if (d + top.bound() >= node.mu) search(node.outside, x, top);
+            if (d - top.bound() <= node.mu) search(node.inside, x, top);
+        }
+    }
+
+   public:
+    VPTree() = default;
+
+    VPTree(std::vector<std::vector<T>> const& data, Distance distance) : distance(std::move(distance)) {
+        if (data.empty()) throw std::invalid_argument("VPTree: empty data");
+        std::vector<std::pair<double, uint32_t>> items(data.size());
+        for (uint32_t i = 0; i < items.size(); ++i) items[i] = {0, i};
+        nodes.reserve(data.size());
+        build(data, items, 0, items.size());
+    }
+
+    // the k nearest (distance, row), nearest first
+    std::vector<std::pair<double, uint32_t>> query(std::vector<T> const& x, size_t k) const {
+        TopK top(k);
+        search(0, x, top);
+        return top.take();
+    }
+};
+
+}  // namespace rxy
@@ -0,0 +1,167 @@
+#include "online_viterbi.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace rxy {
+
+OnlineViterbi::OnlineViterbi(StateIndexPtr index, std::unordered_map<LocKey, Prob> const& init_prob,
+                             size_t lag)
+    : index(std::move(index)), lag(lag), resolve(this->index) {
+    if (lag == 0) throw std::invalid_argument("lag must be positive");
+    auto N = this->index->size();
+    if (init_prob.size() != N) throw std::runtime_error("init_prob.size() != N");
+    init.resize(N);
+    for (uint32_t l = 0; l < N; ++l) {
+        init[l] = init_prob.at(this->index->key(l)).prob;
+    }
+    dp.resize(N);
+    cur.resize(N);
+    emission.resize(N);
+    stamp.assign(N, 0);
+}
+
+uint32_t OnlineViterbi::argmax() const {
+    return static_cast<uint32_t>(std::max_element(dp.begin(), dp.end()) - dp.begin());
+}
+
+std::vector<uint32_t> OnlineViterbi::backtrack(uint32_t l, size_t to) const {
+    std::vector<uint32_t> path(T - frontier);
+    path.back() = l;
+    for (size_t k = path.size() - 1; k-- > 0;) {
+        path[k] = psi[k][path[k + 1]];
+        if (path[k] == Transition::NIL) {
+            // no predecessor: the path is cut here and resumes from the best state, as in the batch viterbi
+#ifdef DEBUG
+            std::cout << frontier + k << " is null" << std::endl;
+#endif
+            path[k] = best[k];
+        }
+    }
+    path.resize(to + 1 - frontier);
+    return path;
+}
+
+void OnlineViterbi::commit(std::vector<uint32_t> const& states, Output& out) {
+    if (states.empty()) return;
+    if (out.committed.empty()) out.committed_from = frontier;
+    for (auto l : states) out.committed.emplace_back((*index)[l]);
+    frontier += states.size();
+    release(std::min(states.size(), psi.size()));
+    best.erase(best.begin(), best.begin() + std::min(states.size(), best.size()));
+}
+
+void OnlineViterbi::release(size_t n) {
+    for (size_t k = 0; k < n; ++k) spare.push_back(std::move(psi[k]));
+    psi.erase(psi.begin(), psi.begin() + n);
+}
+
+void OnlineViterbi::re_init(Output& out) {
+    auto N = index->size();
+    bool all_zero = true;
+    for (uint32_t l = 0; l < N; ++l) {
+        dp[l] = init[l] + emission[l];
+        if (dp[l] != Prob::ZERO.prob) all_zero = false;
+    }
+    if (all_zero) {
+        throw std::runtime_error("all zero for t = " + std::to_string(T));
+    }
+    frontier = T;
+    release(psi.size());
+    best.assign(1, argmax());
+    out.best = (*index)[best.back()];
+}
+
+OnlineViterbi::Output OnlineViterbi::push(MarkovPtr const& markov, EmissionProb const& emission_prob) {
+    auto N = index->size();
+    if (emission_prob.size() != N) throw std::runtime_error("emission.size() != N");
+    for (uint32_t l = 0; l < N; ++l) {
+        emission[l] = emission_prob.at(index->key(l)).prob;
+    }
+
+    Output out{nullptr, frontier, {}};
+    if (T == 0) {
+        re_init(out);
+        ++T;
+        return out;
+    }
+
+    auto transition = &resolve(*markov);
+    if (transition->size() != N) throw std::runtime_error("transition->size() != N");
+
+    if (spare.empty()) spare.emplace_back(N);
+    auto& row = spare.back();
+    row.resize(N);
+    transition->max_product(dp.data(), cur.data(), row.data());
+    bool all_zero = true;
+    for (uint32_t l = 0; l < N; ++l) {
+        cur[l] += emission[l];
+        if (cur[l] != Prob::ZERO.prob) all_zero = false;
+    }
+    if (all_zero) {
+#ifdef DEBUG
+        std::cout << T << ": re-init" << std::endl;
+#endif
+        // recover the path up to T - 1 and restart from T
+        commit(backtrack(argmax(), T - 1), out);
+        re_init(out);
+        ++T;
+        return out;
+    }
+    dp.swap(cur);
+    psi.emplace_back(std::move(row));
+    spare.pop_back();
+    best.push_back(argmax());
+    ++T;
+    out.best = (*index)[best.back()];
+
+    // convergence point: walk back all the surviving paths until they meet. The newest step is
+    // never committed, the next transition starts from it.
+    live.clear();
+    for (uint32_t l = 0; l < N; ++l) {
+        if (dp[l] != Prob::ZERO.prob) live.push_back(l);
+    }
+    // live: the states the surviving paths pass through at time frontier + k
+    size_t k = psi.size();
+    while (live.size() > 1 && k > 0) {
+        --k;
+        ++stamp_id;
+        prev_live.clear();
+        for (auto l : live) {
+            auto p = psi[k][l];
+            if (stamp[p] != stamp_id) {
+                stamp[p] = stamp_id;
+                prev_live.push_back(p);
+            }
+        }
+        live.swap(prev_live);
+    }
+    if (live.size() == 1) {
+        auto to = std::min(frontier + k, T - 2);
+        if (to + 1 > frontier) commit(backtrack(argmax(), to), out);
+    }
+
+    // fixed lag
+    if (T - frontier > lag) {
+        commit(backtrack(argmax(), T - 1 - lag), out);
+    }
+    return out;
+}
+
+OnlineViterbi::Output OnlineViterbi::flush() {
+    Output out{nullptr, frontier, {}};
+    if (T == frontier) return out;
+    auto l = argmax();
+    out.best = (*index)[l];
+    commit(backtrack(l, T - 1), out);
+    // the trace is over, the next push starts a new one
+    T = frontier = 0;
+    release(psi.size());
+    best.clear();
+    return out;
+}
+
+}  // namespace rxy
@@ -0,0 +1,208 @@
+#include "prob_simd.hpp"
+#include <algorithm>
+#include <limits>
+#include "simd_kernels.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RXY_CPUID_GNU
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define RXY_CPUID_MSVC
+#include <intrin.h>
+#endif
+
+namespace rxy::simd {
+
+static constexpr value_type INF = std::numeric_limits<value_type>::infinity();
+static constexpr uint32_t NIL = std::numeric_limits<uint32_t>::max();
+
+#if defined(RXY_CPUID_MSVC)
+// the feature bits of cpuid, and whether the os saves the registers of the mask of xcr0
+static bool cpu_has(int leaf, int reg, int bit) {
+    int r[4];
+    __cpuid(r, 0);
+    if (r[0] < leaf) return false;
+    __cpuidex(r, leaf, 0);
+    return (r[reg] >> bit) & 1;
+}
+
+static bool os_saves(unsigned long long mask) { return cpu_has(1, 2, 27) && (_xgetbv(0) & mask) == mask; }
+#endif
+
+static bool has_avx2() {
+#if defined(RXY_CPUID_GNU)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(RXY_CPUID_MSVC)
+    return cpu_has(7, 1, 5) && cpu_has(1, 2, 12) && os_saves(0x6);
+#else
+    return false;
+#endif
+}
+
+static bool has_avx512() {
+#if defined(RXY_CPUID_GNU)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+#elif defined(RXY_CPUID_MSVC)
+    return cpu_has(7, 1, 16) && os_saves(0xe6);
+#else
+    return false;
+#endif
+}
+
+Kernels const* vector_kernels() {
+    static Kernels const* const kernels = []() -> Kernels const* {
+        if (has_avx512()) {
+            if (auto k = avx512_kernels()) return k;
+        }
+        if (has_avx2()) {
+            if (auto k = avx2_kernels()) return k;
+        }
+        return nullptr;
+    }();
+    return kernels;
+}
+
+/**
+ * The scalar fallback, and the kernels of a PROB_TYPE other than double: the algorithms of the
+ * vector kernels (simd_vec_kernels.hpp) with width 1, written against an accessor at(i) of the terms.
+ * */
+template <class T, class At>
+static T scalar_log_sum_exp(size_t n, At at) {
+    T max = -INF;
+    for (size_t i = 0; i < n; ++i) max = std::max(max, at(i));
+    if (max == -INF || max == INF) return max;
+    T sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += std::exp(at(i) - max);
+    return max + std::log(sum);
+}
+
+template <class T, class At>
+static std::pair<T, uint32_t> scalar_max_plus(size_t n, At at) {
+    T max = -INF;
+    uint32_t arg = NIL;
+    for (size_t i = 0; i < n; ++i) {
+        auto v = at(i);
+        if (v > max) {
+            max = v;
+            arg = static_cast<uint32_t>(i);
+        }
+    }
+    return {max, arg};
+}
+
+template <class T>
+static T log_sum_exp_impl(T const* x, size_t n) {
+    return scalar_log_sum_exp<T>(n, [x](size_t i) { return x[i]; });
+}
+
+template <class T>
+static T log_sum_exp_impl(T const* a, uint32_t const* idx, T const* b, size_t n) {
+    return scalar_log_sum_exp<T>(n, [a, idx, b](size_t i) { return a[idx[i]] + b[i]; });
+}
+
+template <class T>
+static std::pair<T, uint32_t> max_plus_impl(T const* a, uint32_t const* idx, T const* b, size_t n) {
+    return scalar_max_plus<T>(n, [a, idx, b](size_t i) { return a[idx[i]] + b[i]; });
+}
+
+template <class T>
+static void log_nd_pdf_impl(T const* x, T const* mu, T const* inv_sigma, T const* log_norm, T* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        T y = (x[i] - mu[i]) * inv_sigma[i];
+        out[i] = log_norm[i] - 0.5 * y * y;
+    }
+}
+
+template <class T>
+static void log_nd_pdf_impl(T const* x, T* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = rxy::log_nd_pdf(x[i]).prob;
+}
+
+template <class T>
+static void add_log_nd_pdf_impl(T x, T const* mu, T const* inv_sigma, T const* log_norm, T* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        T y = (x - mu[i]) * inv_sigma[i];
+        out[i] += log_norm[i] - 0.5 * y * y;
+    }
+}
+
+template <>
+double log_sum_exp_impl<double>(double const* x, size_t n) {
+    if (auto k = vector_kernels()) return k->log_sum_exp(x, n);
+    return scalar_log_sum_exp<double>(n, [x](size_t i) { return x[i]; });
+}
+
+template <>
+double log_sum_exp_impl<double>(double const* a, uint32_t const* idx, double const* b, size_t n) {
+    if (auto k = vector_kernels()) return k->log_sum_exp_gather(a, idx, b, n);
+    return scalar_log_sum_exp<double>(n, [a, idx, b](size_t i) { return a[idx[i]] + b[i]; });
+}
+
+template <>
+std::pair<double, uint32_t> max_plus_impl<double>(double const* a, uint32_t const* idx, double const* b,
+                                                   size_t n) {
+    if (auto k = vector_kernels()) {
+        uint32_t arg;
+        auto max = k->max_plus_gather(a, idx, b, n, &arg);
+        return {max, arg};
+    }
+    return scalar_max_plus<double>(n, [a, idx, b](size_t i) { return a[idx[i]] + b[i]; });
+}
+
+template <>
+void log_nd_pdf_impl<double>(double const* x, double const* mu, double const* inv_sigma, double const* log_norm,
+                             double* out, size_t n) {
+    if (auto k = vector_kernels()) return k->log_nd_pdf(x, mu, inv_sigma, log_norm, out, n);
+    for (size_t i = 0; i < n; ++i) {
+        double y = (x[i] - mu[i]) * inv_sigma[i];
+        out[i] = log_norm[i] - 0.5 * y * y;
+    }
+}
+
+template <>
+void log_nd_pdf_impl<double>(double const* x, double* out, size_t n) {
+    if (auto k = vector_kernels()) return k->log_nd_pdf_same(x, ND_MU, 1. / ND_SIGMA, INV_SQRT_PI_SIGMA_LOG, out, n);
+    for (size_t i = 0; i < n; ++i) out[i] = rxy::log_nd_pdf(x[i]).prob;
+}
+
+template <>
+void add_log_nd_pdf_impl<double>(double x, double const* mu, double const* inv_sigma, double const* log_norm,
+                                 double* out, size_t n) {
+    if (auto k = vector_kernels()) return k->add_log_nd_pdf(x, mu, inv_sigma, log_norm, out, n);
+    for (size_t i = 0; i < n; ++i) {
+        double y = (x - mu[i]) * inv_sigma[i];
+        out[i] += log_norm[i] - 0.5 * y * y;
+    }
+}
+
+char const* isa() {
+    auto k = vector_kernels();
+    return k ? k->isa : "scalar";
+}
+
+value_type log_sum_exp(value_type const* x, size_t n) { return log_sum_exp_impl(x, n); }
+
+value_type log_sum_exp(value_type const* a, uint32_t const* idx, value_type const* b, size_t n) {
+    return log_sum_exp_impl(a, idx, b, n);
+}
+
+std::pair<value_type, uint32_t> max_plus(value_type const* a, uint32_t const* idx, value_type const* b, size_t n) {
+    auto ret = max_plus_impl(a, idx, b, n);
+    if (ret.second != NIL) ret.second = idx[ret.second];
+    return ret;
+}
+
+void log_nd_pdf(value_type const* x, value_type const* mu, value_type const* inv_sigma,
+                value_type const* log_norm, value_type* out, size_t n) {
+    log_nd_pdf_impl(x, mu, inv_sigma, log_norm, out, n);
+}
+
+void log_nd_pdf(value_type const* x, value_type* out, size_t n) { log_nd_pdf_impl(x, out, n); }
+
+void add_log_nd_pdf(value_type x, value_type const* mu, value_type const* inv_sigma, value_type const* log_norm,
+                    value_type* out, size_t n) {
+    add_log_nd_pdf_impl(x, mu, inv_sigma, log_norm, out, n);
+}
+
+}  // namespace rxy::simd
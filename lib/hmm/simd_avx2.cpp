@@ -0,0 +1,15 @@
+// compiled with AVX2 + FMA (see CMakeLists.txt), called on the cpus that have them only
+#include "simd_vec_kernels.hpp"
+
+namespace rxy::simd {
+
+Kernels const* avx2_kernels() {
+#ifdef RXY_SIMD_AVX2
+    static constexpr Kernels kernels = vec_kernels("avx2");
+    return &kernels;
+#else
+    return nullptr;
+#endif
+}
+
+}  // namespace rxy::simd
@@ -0,0 +1,15 @@
+// compiled with AVX-512 (see CMakeLists.txt), called on the cpus that have it only
+#include "simd_vec_kernels.hpp"
+
+namespace rxy::simd {
+
+Kernels const* avx512_kernels() {
+#ifdef RXY_SIMD_AVX512
+    static constexpr Kernels kernels = vec_kernels("avx512");
+    return &kernels;
+#else
+    return nullptr;
+#endif
+}
+
+}  // namespace rxy::simd
@@ -0,0 +1,38 @@
+#pragma once
+// the vector kernels of one instruction set, private to lib/hmm
+#include <cstddef>
+#include <cstdint>
+
+namespace rxy::simd {
+
+/**
+ * @brief The kernels of prob_simd.hpp and distance_simd.hpp compiled for one instruction set, by
+ * the translation units of that set only (simd_avx2.cpp, simd_avx512.cpp, see CMakeLists.txt).
+ * Plain functions over doubles, so that nothing inline is shared with the rest of the library.
+ * */
+struct Kernels {
+    char const* isa;
+    double (*log_sum_exp)(double const* x, size_t n);
+    double (*log_sum_exp_gather)(double const* a, uint32_t const* idx, double const* b, size_t n);
+    // the max, and its first position i in *arg (NIL if every term is -inf)
+    double (*max_plus_gather)(double const* a, uint32_t const* idx, double const* b, size_t n, uint32_t* arg);
+    void (*log_nd_pdf)(double const* x, double const* mu, double const* inv_sigma, double const* log_norm,
+                       double* out, size_t n);
+    // log_nd_pdf with the same parameters for every x
+    void (*log_nd_pdf_same)(double const* x, double mu, double inv_sigma, double log_norm, double* out, size_t n);
+    void (*add_log_nd_pdf)(double x, double const* mu, double const* inv_sigma, double const* log_norm,
+                           double* out, size_t n);
+    void (*weighted_sq_distances)(double const* x, double const* w, double const* cols, size_t stride,
+                                  size_t dim, size_t begin, size_t end, double* out);
+    void (*pow_distances)(double const* x, int p, double const* cols, size_t stride, size_t dim, size_t begin,
+                          size_t end, double* out);
+};
+
+// nullptr if not compiled for the set; only to be called on a cpu that has it
+Kernels const* avx2_kernels();
+Kernels const* avx512_kernels();
+
+// the kernels of the best set of the cpu, chosen once; nullptr for the scalar fallback
+Kernels const* vector_kernels();
+
+}  // namespace rxy::simd
@@ -0,0 +1,83 @@
+#pragma once
+// the vector registers of the kernels (simd_vec_kernels.hpp), private to lib/hmm: those of the
+// instruction set the translation unit is compiled for, local to it
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX512F__)
+#define RXY_SIMD_AVX512
+#include <immintrin.h>
+#elif defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define RXY_SIMD_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(RXY_SIMD_AVX512) || defined(RXY_SIMD_AVX2)
+#define RXY_SIMD
+
+namespace rxy::simd {
+namespace {
+
+#if defined(RXY_SIMD_AVX512)
+struct Vec {
+    using reg = __m512d;
+    static constexpr size_t width = 8;
+    static reg load(double const* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, reg v) { _mm512_storeu_pd(p, v); }
+    static reg gather(double const* base, uint32_t const* idx) {
+        return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xff,
+                                        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(idx)), base, 8);
+    }
+    static reg set1(double v) { return _mm512_set1_pd(v); }
+    static reg iota() { return _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0); }
+    static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+    static reg max(reg a, reg b) { return _mm512_max_pd(a, b); }
+    static reg abs(reg a) { return _mm512_abs_pd(a); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+    static reg round(reg a) { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    // a * 2^n, n integral
+    static reg ldexp(reg a, reg n) { return _mm512_scalef_pd(a, n); }
+    // the lanes of x where a > b, those of y elsewhere
+    static reg select_gt(reg a, reg b, reg x, reg y) {
+        return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(a, b, _CMP_GT_OQ), y, x);
+    }
+};
+#else
+struct Vec {
+    using reg = __m256d;
+    static constexpr size_t width = 4;
+    static reg load(double const* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, reg v) { _mm256_storeu_pd(p, v); }
+    static reg gather(double const* base, uint32_t const* idx) {
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base,
+                                        _mm_loadu_si128(reinterpret_cast<__m128i const*>(idx)),
+                                        _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+    }
+    static reg set1(double v) { return _mm256_set1_pd(v); }
+    static reg iota() { return _mm256_set_pd(3, 2, 1, 0); }
+    static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+    static reg max(reg a, reg b) { return _mm256_max_pd(a, b); }
+    static reg abs(reg a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+    static reg round(reg a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    // a * 2^n, n integral in [-1022, 1023]: the biased exponent is built through the 1.5 * 2^52 trick
+    static reg ldexp(reg a, reg n) {
+        auto magic = _mm256_set1_pd(6755399441055744.0);
+        auto e = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(n, magic)), _mm256_castpd_si256(magic));
+        e = _mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52);
+        return _mm256_mul_pd(a, _mm256_castsi256_pd(e));
+    }
+    static reg select_gt(reg a, reg b, reg x, reg y) {
+        return _mm256_blendv_pd(y, x, _mm256_cmp_pd(a, b, _CMP_GT_OQ));
+    }
+};
+#endif
+
+}  // namespace
+}  // namespace rxy::simd
+
+#endif
@@ -0,0 +1,227 @@
+#pragma once
+// the Kernels over the Vec of the translation unit, included by simd_avx2.cpp and simd_avx512.cpp only
+#include <cmath>
+#include <limits>
+#include "simd_kernels.hpp"
+#include "simd_vec.hpp"
+
+#ifdef RXY_SIMD
+
+namespace rxy::simd {
+namespace {
+
+/**
+ * Everything here is local to the translation unit and compiled for its instruction set: no inline
+ * function of a header is used (std::max, std::pair, Prob...), the linker could otherwise keep this
+ * copy of it for the whole program.
+ *
+ * Every kernel is written once against an accessor of its terms: load(i) returns the vector of the
+ * terms [i, i + width), at(i) the single term i, for the tails.
+ * */
+
+using reg = Vec::reg;
+constexpr size_t W = Vec::width;
+constexpr double INF = std::numeric_limits<double>::infinity();
+constexpr uint32_t NIL = std::numeric_limits<uint32_t>::max();
+
+/**
+ * exp(x) = 2^n * exp(r), n = round(x / ln2), |r| <= ln2 / 2, exp(r) by its Taylor polynomial of
+ * degree 12 (relative error < 2e-16). Underflows to 0 below -708, the inputs are x - max <= 0.
+ * */
+reg exp(reg x) {
+    constexpr double LOG2E = 1.4426950408889634074;
+    constexpr double LN2_HI = 0.693145751953125;
+    constexpr double LN2_LO = 1.42860682030941723212e-6;
+    constexpr double C[] = {
+        1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320,
+        1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600,
+    };
+    auto lo = Vec::set1(-708.0);
+    auto xc = Vec::max(x, lo);
+    auto n = Vec::round(Vec::mul(xc, Vec::set1(LOG2E)));
+    auto r = Vec::fmadd(n, Vec::set1(-LN2_HI), xc);
+    r = Vec::fmadd(n, Vec::set1(-LN2_LO), r);
+    auto p = Vec::set1(C[12]);
+    for (int k = 11; k >= 0; --k) p = Vec::fmadd(p, r, Vec::set1(C[k]));
+    return Vec::select_gt(lo, x, Vec::set1(0), Vec::ldexp(p, n));
+}
+
+template <class Load, class At>
+double vec_log_sum_exp(size_t n, Load load, At at) {
+    size_t m = n - n % W;
+    alignas(64) double lane[W];
+    double max = -INF;
+    if (m) {
+        auto vmax = Vec::set1(-INF);
+        for (size_t i = 0; i < m; i += W) vmax = Vec::max(vmax, load(i));
+        Vec::store(lane, vmax);
+        for (size_t k = 0; k < W; ++k) max = lane[k] > max ? lane[k] : max;
+    }
+    for (size_t i = m; i < n; ++i) {
+        auto v = at(i);
+        max = v > max ? v : max;
+    }
+    if (max == -INF || max == INF) return max;
+    auto vsum = Vec::set1(0);
+    auto shift = Vec::set1(max);
+    for (size_t i = 0; i < m; i += W) vsum = Vec::add(vsum, exp(Vec::sub(load(i), shift)));
+    Vec::store(lane, vsum);
+    double sum = 0;
+    for (size_t k = 0; k < W; ++k) sum += lane[k];
+    for (size_t i = m; i < n; ++i) sum += std::exp(at(i) - max);
+    return max + std::log(sum);
+}
+
+template <class Load, class At>
+double vec_max_plus(size_t n, Load load, At at, uint32_t* arg) {
+    size_t m = n - n % W;
+    double max = -INF;
+    *arg = NIL;
+    if (m) {
+        // per lane: the first maximum, then the smallest index among the lanes holding the maximum
+        auto vmax = Vec::set1(-INF), varg = Vec::set1(0), vi = Vec::iota(), step = Vec::set1(W);
+        for (size_t i = 0; i < m; i += W) {
+            auto v = load(i);
+            varg = Vec::select_gt(v, vmax, vi, varg);
+            vmax = Vec::max(vmax, v);
+            vi = Vec::add(vi, step);
+        }
+        alignas(64) double lane_max[W], lane_arg[W];
+        Vec::store(lane_max, vmax);
+        Vec::store(lane_arg, varg);
+        for (size_t k = 0; k < W; ++k) {
+            if (lane_max[k] == -INF) continue;
+            auto a = static_cast<uint32_t>(lane_arg[k]);
+            if (lane_max[k] > max || (lane_max[k] == max && a < *arg)) {
+                max = lane_max[k];
+                *arg = a;
+            }
+        }
+    }
+    for (size_t i = m; i < n; ++i) {
+        auto v = at(i);
+        if (v > max) {
+            max = v;
+            *arg = static_cast<uint32_t>(i);
+        }
+    }
+    return max;
+}
+
+double log_sum_exp(double const* x, size_t n) {
+    return vec_log_sum_exp(n, [x](size_t i) { return Vec::load(x + i); }, [x](size_t i) { return x[i]; });
+}
+
+double log_sum_exp_gather(double const* a, uint32_t const* idx, double const* b, size_t n) {
+    return vec_log_sum_exp(
+        n, [a, idx, b](size_t i) { return Vec::add(Vec::gather(a, idx + i), Vec::load(b + i)); },
+        [a, idx, b](size_t i) { return a[idx[i]] + b[i]; });
+}
+
+double max_plus_gather(double const* a, uint32_t const* idx, double const* b, size_t n, uint32_t* arg) {
+    return vec_max_plus(
+        n, [a, idx, b](size_t i) { return Vec::add(Vec::gather(a, idx + i), Vec::load(b + i)); },
+        [a, idx, b](size_t i) { return a[idx[i]] + b[i]; }, arg);
+}
+
+void log_nd_pdf(double const* x, double const* mu, double const* inv_sigma, double const* log_norm, double* out,
+                size_t n) {
+    size_t m = n - n % W;
+    auto half = Vec::set1(-0.5);
+    for (size_t i = 0; i < m; i += W) {
+        auto y = Vec::mul(Vec::sub(Vec::load(x + i), Vec::load(mu + i)), Vec::load(inv_sigma + i));
+        Vec::store(out + i, Vec::fmadd(Vec::mul(half, y), y, Vec::load(log_norm + i)));
+    }
+    for (size_t i = m; i < n; ++i) {
+        double y = (x[i] - mu[i]) * inv_sigma[i];
+        out[i] = log_norm[i] - 0.5 * y * y;
+    }
+}
+
+void log_nd_pdf_same(double const* x, double mu, double inv_sigma, double log_norm, double* out, size_t n) {
+    size_t m = n - n % W;
+    auto vmu = Vec::set1(mu), vinv_sigma = Vec::set1(inv_sigma);
+    auto half = Vec::set1(-0.5), norm = Vec::set1(log_norm);
+    for (size_t i = 0; i < m; i += W) {
+        auto y = Vec::mul(Vec::sub(Vec::load(x + i), vmu), vinv_sigma);
+        Vec::store(out + i, Vec::fmadd(Vec::mul(half, y), y, norm));
+    }
+    for (size_t i = m; i < n; ++i) {
+        double y = (x[i] - mu) * inv_sigma;
+        out[i] = log_norm - 0.5 * y * y;
+    }
+}
+
+void add_log_nd_pdf(double x, double const* mu, double const* inv_sigma, double const* log_norm, double* out,
+                    size_t n) {
+    size_t m = n - n % W;
+    auto vx = Vec::set1(x), half = Vec::set1(-0.5);
+    for (size_t i = 0; i < m; i += W) {
+        auto y = Vec::mul(Vec::sub(vx, Vec::load(mu + i)), Vec::load(inv_sigma + i));
+        auto term = Vec::fmadd(Vec::mul(half, y), y, Vec::load(log_norm + i));
+        Vec::store(out + i, Vec::add(Vec::load(out + i), term));
+    }
+    for (size_t i = m; i < n; ++i) {
+        double y = (x - mu[i]) * inv_sigma[i];
+        out[i] += log_norm[i] - 0.5 * y * y;
+    }
+}
+
+/**
+ * One pass over the rows, a vector of consecutive rows at a time: the columns are read
+ * contiguously and the query is broadcast, the tails are scalar.
+ * */
+void weighted_sq_distances(double const* x, double const* w, double const* cols, size_t stride, size_t dim,
+                           size_t begin, size_t end, double* out) {
+    size_t r = begin;
+    for (; r + W <= end; r += W) {
+        auto acc = Vec::set1(0);
+        for (size_t i = 0; i < dim; ++i) {
+            auto d = Vec::sub(Vec::set1(x[i]), Vec::load(cols + i * stride + r));
+            acc = Vec::fmadd(Vec::mul(Vec::set1(w[i]), d), d, acc);
+        }
+        Vec::store(out + (r - begin), acc);
+    }
+    for (; r < end; ++r) {
+        double sum = 0;
+        for (size_t i = 0; i < dim; ++i) {
+            double d = x[i] - cols[i * stride + r];
+            sum += w[i] * d * d;
+        }
+        out[r - begin] = sum;
+    }
+}
+
+void pow_distances(double const* x, int p, double const* cols, size_t stride, size_t dim, size_t begin,
+                   size_t end, double* out) {
+    size_t r = begin;
+    for (; r + W <= end; r += W) {
+        auto acc = Vec::set1(0);
+        for (size_t i = 0; i < dim; ++i) {
+            auto d = Vec::abs(Vec::sub(Vec::set1(x[i]), Vec::load(cols + i * stride + r)));
+            auto t = d;
+            for (int k = 1; k < p; ++k) t = Vec::mul(t, d);
+            acc = Vec::add(acc, t);
+        }
+        Vec::store(out + (r - begin), acc);
+    }
+    for (; r < end; ++r) {
+        double sum = 0;
+        for (size_t i = 0; i < dim; ++i) {
+            double d = std::fabs(x[i] - cols[i * stride + r]), t = d;
+            for (int k = 1; k < p; ++k) t *= d;
+            sum += t;
+        }
+        out[r - begin] = sum;
+    }
+}
+
+constexpr Kernels vec_kernels(char const* isa) {
+    return {isa, log_sum_exp, log_sum_exp_gather, max_plus_gather, log_nd_pdf, log_nd_pdf_same,
+            add_log_nd_pdf, weighted_sq_distances, pow_distances};
+}
+
+}  // namespace
+}  // namespace rxy::simd
+
+#endif
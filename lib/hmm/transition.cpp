@@ -0,0 +1,187 @@
+#include "transition.hpp"
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+#include "prob_simd.hpp"
+
+namespace rxy {
+
+void Transition::max_product_sparse(value_type const* prev, std::vector<uint32_t> const&,
+                                    value_type* cur, uint32_t* psi,
+                                    std::vector<uint32_t>& touched) const {
+    max_product(prev, cur, psi);
+    for (uint32_t l = 0; l < size(); ++l) {
+        if (psi[l] != NIL) touched.push_back(l);
+    }
+}
+
+SparseTransition::SparseTransition(
+    size_t N, std::vector<std::vector<std::pair<uint32_t, value_type>>> const& out_edges)
+    : N(N), rows(N) {
+    if (out_edges.size() != N) throw std::invalid_argument("out_edges.size() != N");
+    std::iota(rows.begin(), rows.end(), 0);
+    struct Vectors {
+        std::vector<size_t> row_ptr, col_ptr;
+        std::vector<uint32_t> src, dst;
+        std::vector<value_type> log_prob, col_log_prob;
+    };
+    auto v = std::make_shared<Vectors>();
+    auto &row_ptr = v->row_ptr, &col_ptr = v->col_ptr;
+    auto &src = v->src, &dst = v->dst;
+    auto &log_prob = v->log_prob, &col_log_prob = v->col_log_prob;
+    // counting sort of the edges by destination, sources stay ascending in every row
+    row_ptr.assign(N + 1, 0);
+    for (auto&& edges : out_edges) {
+        for (auto&& [dst, _] : edges) ++row_ptr[dst + 1];
+    }
+    for (size_t dst = 0; dst < N; ++dst) row_ptr[dst + 1] += row_ptr[dst];
+    src.resize(row_ptr[N]);
+    log_prob.resize(row_ptr[N]);
+    std::vector<size_t> fill(row_ptr.begin(), row_ptr.end() - 1);
+    for (uint32_t s = 0; s < out_edges.size(); ++s) {
+        for (auto&& [d, prob] : out_edges[s]) {
+            auto k = fill[d]++;
+            src[k] = s;
+            log_prob[k] = prob;
+        }
+    }
+    // CSC: the out edges sorted by destination
+    col_ptr.assign(N + 1, 0);
+    dst.reserve(src.size());
+    col_log_prob.reserve(src.size());
+    for (uint32_t s = 0; s < out_edges.size(); ++s) {
+        auto edges = out_edges[s];
+        std::sort(edges.begin(), edges.end());
+        for (auto&& [d, prob] : edges) {
+            dst.push_back(d);
+            col_log_prob.push_back(prob);
+        }
+        col_ptr[s + 1] = dst.size();
+    }
+    this->row_ptr = row_ptr;
+    this->src = src;
+    this->log_prob = log_prob;
+    this->col_ptr = col_ptr;
+    this->dst = dst;
+    this->col_log_prob = col_log_prob;
+    storage = std::move(v);
+}
+
+SparseTransition::SparseTransition(size_t N, Arrays const& arrays, std::shared_ptr<void const> storage)
+    : N(N),
+      storage(std::move(storage)),
+      row_ptr(arrays.row_ptr),
+      src(arrays.src),
+      log_prob(arrays.log_prob),
+      col_ptr(arrays.col_ptr),
+      dst(arrays.dst),
+      col_log_prob(arrays.col_log_prob),
+      rows(N) {
+    auto nnz = src.size();
+    if (row_ptr.size() != N + 1 || col_ptr.size() != N + 1 || log_prob.size() != nnz ||
+        dst.size() != nnz || col_log_prob.size() != nnz || row_ptr[N] != nnz || col_ptr[N] != nnz)
+        throw std::invalid_argument("SparseTransition: inconsistent arrays");
+    // the kernels index with them unchecked: a corrupt file must not read out of the arrays
+    auto in_range = [N](uint32_t l) { return l < N; };
+    if (row_ptr[0] != 0 || col_ptr[0] != 0 || !std::is_sorted(row_ptr.begin(), row_ptr.end()) ||
+        !std::is_sorted(col_ptr.begin(), col_ptr.end()) || !std::all_of(src.begin(), src.end(), in_range) ||
+        !std::all_of(dst.begin(), dst.end(), in_range))
+        throw std::invalid_argument("SparseTransition: corrupt arrays");
+    std::iota(rows.begin(), rows.end(), 0);
+}
+
+void SparseTransition::max_product_sparse(value_type const* prev, std::vector<uint32_t> const& active,
+                                          value_type* cur, uint32_t* psi,
+                                          std::vector<uint32_t>& touched) const {
+    for (auto s : active) {
+        for (auto k = col_ptr[s]; k < col_ptr[s + 1]; ++k) {
+            auto d = dst[k];
+            value_type prob = prev[s] + col_log_prob[k];
+            if (psi[d] == NIL) {
+                touched.push_back(d);
+                cur[d] = prob;
+                psi[d] = s;
+            } else if (prob > cur[d]) {
+                cur[d] = prob;
+                psi[d] = s;
+            }
+        }
+    }
+}
+
+SparseTransition::value_type SparseTransition::operator()(uint32_t dst, uint32_t s) const {
+    auto row = row_src(dst);
+    auto it = std::lower_bound(row.begin(), row.end(), s);
+    if (it == row.end() || *it != s) return Prob::ZERO.prob;
+    return log_prob[row_ptr[dst] + (it - row.begin())];
+}
+
+void SparseTransition::max_product(value_type const* prev, value_type* cur, uint32_t* psi) const {
+    std::for_each(std::execution::par_unseq, rows.begin(), rows.end(),
+        [this, prev, cur, psi](uint32_t dst) {
+            auto k = row_ptr[dst];
+            std::tie(cur[dst], psi[dst]) =
+                simd::max_plus(prev, src.data() + k, log_prob.data() + k, row_ptr[dst + 1] - k);
+        });
+}
+
+void SparseTransition::sum_product(value_type const* prev, value_type* cur) const {
+    std::for_each(std::execution::par_unseq, rows.begin(), rows.end(),
+        [this, prev, cur](uint32_t d) {
+            auto k = row_ptr[d];
+            cur[d] = simd::log_sum_exp(prev, src.data() + k, log_prob.data() + k, row_ptr[d + 1] - k);
+        });
+}
+
+void SparseTransition::sum_product_transposed(value_type const* next, value_type* cur) const {
+    std::for_each(std::execution::par_unseq, rows.begin(), rows.end(),
+        [this, next, cur](uint32_t s) {
+            auto k = col_ptr[s];
+            cur[s] = simd::log_sum_exp(next, dst.data() + k, col_log_prob.data() + k, col_ptr[s + 1] - k);
+        });
+}
+
+PermutedTransition::PermutedTransition(Transition const& inner, StateIndex const& inner_index,
+                                       StateIndex const& index)
+    : inner(inner), to_inner(index.size()), from_inner(inner_index.size(), NIL) {
+    for (uint32_t l = 0; l < index.size(); ++l) {
+        to_inner[l] = inner_index.at(index[l]);
+        from_inner[to_inner[l]] = l;
+    }
+}
+
+std::vector<Transition::value_type> PermutedTransition::gather(value_type const* in) const {
+    std::vector<value_type> buf(from_inner.size(), Prob::ZERO.prob);
+    for (uint32_t l = 0; l < to_inner.size(); ++l) buf[to_inner[l]] = in[l];
+    return buf;
+}
+
+void PermutedTransition::max_product(value_type const* prev, value_type* cur, uint32_t* psi) const {
+    auto prev_buf = gather(prev);
+    std::vector<value_type> cur_buf(from_inner.size());
+    std::vector<uint32_t> psi_buf(from_inner.size());
+    inner.max_product(prev_buf.data(), cur_buf.data(), psi_buf.data());
+    for (uint32_t l = 0; l < to_inner.size(); ++l) {
+        cur[l] = cur_buf[to_inner[l]];
+        auto p = psi_buf[to_inner[l]];
+        psi[l] = p == NIL ? NIL : from_inner[p];
+    }
+}
+
+void PermutedTransition::sum_product(value_type const* prev, value_type* cur) const {
+    auto prev_buf = gather(prev);
+    std::vector<value_type> cur_buf(from_inner.size());
+    inner.sum_product(prev_buf.data(), cur_buf.data());
+    for (uint32_t l = 0; l < to_inner.size(); ++l) cur[l] = cur_buf[to_inner[l]];
+}
+
+void PermutedTransition::sum_product_transposed(value_type const* next, value_type* cur) const {
+    auto next_buf = gather(next);
+    std::vector<value_type> cur_buf(from_inner.size());
+    inner.sum_product_transposed(next_buf.data(), cur_buf.data());
+    for (uint32_t l = 0; l < to_inner.size(); ++l) cur[l] = cur_buf[to_inner[l]];
+}
+
+}  // namespace rxy
@@ -0,0 +1,207 @@
+#include "viterbi.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace rxy {
+
+/**
+ * Same recurrence as HMM::viterbi, on a T x N score buffer and a (T - 1) x N backpointer buffer:
+ * dp[t][l] = max_{l'} dp[t - 1][l'] * P(l' -> l) * P(l -> r), psi[t - 1][l] = argmax_{l'}.
+ * If every state of dp[t] becomes ZERO, the path up to t - 1 is recovered and the recursion is
+ * re-initialized at t.
+ * */
+std::vector<uint32_t> viterbi(std::vector<Transition const*> const& transitions,
+                              std::vector<Prob::value_type> const& init,
+                              std::vector<Prob::value_type> const& emissions) {
+    using value_type = Prob::value_type;
+    auto N = init.size();
+    if (N == 0) throw std::runtime_error("N == 0");
+    if (emissions.size() % N != 0) throw std::runtime_error("emissions.size() % N != 0");
+    auto T = emissions.size() / N;
+    if (T == 0) throw std::runtime_error("T == 0");
+    if (transitions.size() != T - 1) throw std::runtime_error("transitions.size() != T - 1");
+    for (auto&& transition : transitions) {
+        if (transition->size() != N) throw std::runtime_error("transition->size() != N");
+    }
+
+    std::vector<value_type> dp(T * N);
+    std::vector<uint32_t> psi((T - 1) * N);
+
+    auto init_at = [&init, &emissions, &dp, N](size_t t) {
+        bool all_zero = true;
+        auto cur = dp.data() + t * N;
+        auto et = emissions.data() + t * N;
+        for (size_t l = 0; l < N; ++l) {
+            cur[l] = init[l] + et[l];
+            if (cur[l] != Prob::ZERO.prob) all_zero = false;
+        }
+        if (all_zero) {
+            throw std::runtime_error("all zero for t = " + std::to_string(t));
+        }
+    };
+
+    auto argmax = [&dp, N](size_t t) {
+        auto row = dp.data() + t * N;
+        return static_cast<uint32_t>(std::max_element(row, row + N) - row);
+    };
+
+    std::vector<uint32_t> ret(T);
+    auto recover = [&ret, &psi, &argmax, N](size_t s, size_t t) {
+        ret[t] = argmax(t);
+        for (size_t i = t; i-- > s;) {
+            ret[i] = psi[i * N + ret[i + 1]];
+            if (ret[i] == Transition::NIL) {
+#ifdef DEBUG
+                std::cerr << i << " is null" << std::endl;
+#endif
+                ret[i] = argmax(i);
+            }
+        }
+    };
+
+    size_t start = 0;
+    init_at(0);
+    for (size_t t = 1; t < T; ++t) {
+        auto cur = dp.data() + t * N;
+        transitions[t - 1]->max_product(dp.data() + (t - 1) * N, cur, psi.data() + (t - 1) * N);
+        auto et = emissions.data() + t * N;
+        bool all_zero = true;
+        for (size_t l = 0; l < N; ++l) {
+            cur[l] += et[l];
+            if (cur[l] != Prob::ZERO.prob) all_zero = false;
+        }
+        if (all_zero) {
+#ifdef DEBUG
+            std::cout << t << ": re-init" << std::endl;
+#endif
+            recover(start, t - 1);
+            start = t;
+            init_at(start);
+        }
+    }
+    recover(start, T - 1);
+    return ret;
+}
+
+std::vector<uint32_t> viterbi(std::vector<Transition const*> const& transitions,
+                              std::vector<Prob::value_type> const& init,
+                              std::vector<Prob::value_type> const& emissions, Beam const& beam) {
+    using value_type = Prob::value_type;
+    // a negative (or NaN) threshold would empty the beam
+    if (!(beam.threshold >= 0)) throw std::runtime_error("beam.threshold < 0");
+    if (!beam.enabled()) return viterbi(transitions, init, emissions);
+    auto N = init.size();
+    if (N == 0) throw std::runtime_error("N == 0");
+    if (emissions.size() % N != 0) throw std::runtime_error("emissions.size() % N != 0");
+    auto T = emissions.size() / N;
+    if (T == 0) throw std::runtime_error("T == 0");
+    if (transitions.size() != T - 1) throw std::runtime_error("transitions.size() != T - 1");
+    for (auto&& transition : transitions) {
+        if (transition->size() != N) throw std::runtime_error("transition->size() != N");
+    }
+
+    // the beam of every step: states, their scores, and the position of their predecessor in the
+    // beam of the previous step
+    std::vector<std::vector<uint32_t>> states(T), back(T);
+    std::vector<std::vector<value_type>> scores(T);
+    // dense work buffers, kept ZERO / NIL outside the current beam
+    std::vector<value_type> prev(N, Prob::ZERO.prob), cur(N, Prob::ZERO.prob);
+    std::vector<uint32_t> psi(N, Transition::NIL), pos(N);
+    std::vector<uint32_t> touched, candidates;
+
+    // keep the candidates within the threshold of the best, then the `width` best of them
+    auto select = [&beam, &cur, &states, &scores](size_t t, std::vector<uint32_t>& cand) {
+        value_type best = Prob::ZERO.prob;
+        for (auto l : cand) best = std::max(best, cur[l]);
+        std::erase_if(cand, [&cur, &beam, best](uint32_t l) { return cur[l] < best - beam.threshold; });
+        if (beam.width != 0 && cand.size() > beam.width) {
+            std::nth_element(cand.begin(), cand.begin() + beam.width, cand.end(),
+                             [&cur](uint32_t a, uint32_t b) { return cur[a] > cur[b]; });
+            cand.resize(beam.width);
+        }
+        states[t] = cand;
+        scores[t].resize(cand.size());
+        for (size_t i = 0; i < cand.size(); ++i) scores[t][i] = cur[cand[i]];
+    };
+
+    auto enter = [&states, &scores, &prev, &pos](size_t t) {
+        for (size_t i = 0; i < states[t].size(); ++i) {
+            prev[states[t][i]] = scores[t][i];
+            pos[states[t][i]] = static_cast<uint32_t>(i);
+        }
+    };
+
+    auto leave = [&states, &prev](size_t t) {
+        for (auto l : states[t]) prev[l] = Prob::ZERO.prob;
+    };
+
+    auto init_at = [&](size_t t) {
+        candidates.clear();
+        auto et = emissions.data() + t * N;
+        for (uint32_t l = 0; l < N; ++l) {
+            cur[l] = init[l] + et[l];
+            if (cur[l] != Prob::ZERO.prob) candidates.push_back(l);
+        }
+        if (candidates.empty()) {
+            throw std::runtime_error("all zero for t = " + std::to_string(t));
+        }
+        select(t, candidates);
+        back[t].assign(states[t].size(), Transition::NIL);
+        std::fill(cur.begin(), cur.end(), Prob::ZERO.prob);
+        enter(t);
+    };
+
+    std::vector<uint32_t> ret(T);
+    auto recover = [&ret, &states, &scores, &back](size_t s, size_t t) {
+        auto i = static_cast<uint32_t>(std::max_element(scores[t].begin(), scores[t].end()) -
+                                       scores[t].begin());
+        ret[t] = states[t][i];
+        for (size_t k = t; k > s; --k) {
+            i = back[k][i];
+            ret[k - 1] = states[k - 1][i];
+        }
+    };
+
+    size_t start = 0;
+    init_at(0);
+    for (size_t t = 1; t < T; ++t) {
+        touched.clear();
+        transitions[t - 1]->max_product_sparse(prev.data(), states[t - 1], cur.data(), psi.data(), touched);
+        auto et = emissions.data() + t * N;
+        candidates.clear();
+        for (auto l : touched) {
+            cur[l] += et[l];
+            if (cur[l] != Prob::ZERO.prob) candidates.push_back(l);
+        }
+        leave(t - 1);
+        if (candidates.empty()) {
+#ifdef DEBUG
+            std::cout << t << ": re-init" << std::endl;
+#endif
+            for (auto l : touched) {
+                cur[l] = Prob::ZERO.prob;
+                psi[l] = Transition::NIL;
+            }
+            recover(start, t - 1);
+            start = t;
+            init_at(start);
+            continue;
+        }
+        select(t, candidates);
+        back[t].resize(states[t].size());
+        for (size_t i = 0; i < states[t].size(); ++i) back[t][i] = pos[psi[states[t][i]]];
+        for (auto l : touched) {
+            cur[l] = Prob::ZERO.prob;
+            psi[l] = Transition::NIL;
+        }
+        enter(t);
+    }
+    recover(start, T - 1);
+    return ret;
+}
+
+}  // namespace rxy
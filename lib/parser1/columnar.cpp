@@ -0,0 +1,252 @@
+#include "columnar.h"
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <execution>
+#include <numeric>
+#include <thread>
+
+namespace rxy {
+
+static std::string describe(char const* p, char const* end) {
+    if (p == end) return "END of FILE";
+    if (*p == '\n' || *p == '\r') return "END of LINE";
+    return std::string(1, *p);
+}
+
+void ColumnScanner::fail(std::string const& what, bool found) const {
+    throw ParseError(what + " at line " + std::to_string(_line) + ", col " + std::to_string(col()) +
+                     (found ? " instead of '" + describe(p, end) + "'" : ""));
+}
+
+void ColumnScanner::newline() {
+    if (*p++ == '\r' && p != end && *p == '\n') ++p;
+    ++_line;
+    line_begin = p;
+}
+
+void ColumnScanner::expect(char c) {
+    if (p == end) fail(std::string("Unexpected end of file: should be a '") + c + "'");
+    if (*p != c) fail(std::string("should be a '") + c + "'", true);
+    ++p;
+}
+
+/**
+ * as Lexer::next: an optional '-' followed by spaces, then digits [. digits] [e [+-] digits];
+ * false, p unmoved, if there is no number at p
+ * */
+bool ColumnScanner::scan_number(double& x) {
+    auto q = p;
+    bool neg = q != end && *q == '-';
+    if (neg) {
+        ++q;
+        while (q != end && *q == ' ') ++q;
+    }
+    if (q == end || *q < '0' || *q > '9') return false;
+    auto [r, ec] = std::from_chars(q, end, x);
+    if (ec != std::errc()) return false;
+    p = r;
+    if (neg) x = -x;
+    return true;
+}
+
+// an integral number, as the INT of the Lexer: 117.0 and 1e2 are integers
+int ColumnScanner::integer(char const* as) {
+    // the plain digits of nearly every integer, without the double
+    int i;
+    auto [q, ec] = std::from_chars(p, end, i);
+    if (ec == std::errc() && (q == end || (*q != '.' && *q != 'e' && *q != 'E'))) {
+        p = q;
+        return i;
+    }
+    auto start = p;
+    double x;
+    if (!scan_number(x) || !(x >= INT_MIN && x <= INT_MAX && x == static_cast<int>(x))) {
+        p = start;
+        fail(std::string("should be an integer (as ") + as + ")");
+    }
+    return static_cast<int>(x);
+}
+
+double ColumnScanner::number() {
+    double x;
+    if (!scan_number(x)) fail("should be a number (as rsrp)");
+    return x;
+}
+
+/**
+ * Item -> < PCI, rsrp, 4G/5G>
+ * */
+void ColumnScanner::item(CellColumns& out) {
+    expect('<');
+    skip_blank();
+    out.pci.push_back(integer("pci"));
+    skip_blank();
+    expect(',');
+    skip_blank();
+    out.rsrp.push_back(number());
+    skip_blank();
+    expect(',');
+    skip_blank();
+    if (end - p < 2 || (p[0] != '4' && p[0] != '5') || p[1] != 'G') fail("should be a '4G' or '5G'");
+    out.g5.push_back(p[0] == '5');
+    p += 2;
+    skip_blank();
+    expect('>');
+}
+
+bool ColumnScanner::next(CellColumns& out) {
+    for (;;) {
+        skip_blank();
+        if (p == end) return false;
+        if (*p != '\n' && *p != '\r') break;
+        newline();
+    }
+    auto loc = integer("location id");
+    skip_blank();
+    expect(':');
+    skip_blank();
+    expect('[');
+    skip_blank();
+    if (p == end || *p != ']') {
+        item(out);
+        skip_blank();
+        while (p != end && *p == ',') {
+            ++p;
+            skip_blank();
+            item(out);
+            skip_blank();
+        }
+    }
+    expect(']');
+    skip_blank();
+    if (p != end) {
+        if (*p != '\n' && *p != '\r') fail("should be a 'END of LINE'", true);
+        newline();
+    }
+    out.loc.push_back(loc);
+    out.offset.push_back(out.pci.size());
+    return true;
+}
+
+CellColumns parse_columns(std::string_view text) {
+    CellColumns ret;
+    // ~ 18 bytes an item ("<117, -88.9, 5G>, ") and 6 items a row in the drive test logs
+    ret.reserve(text.size() / 110, text.size() / 18);
+    ColumnScanner scanner(text);
+    while (scanner.next(ret)) {
+    }
+    return ret;
+}
+
+// the end of the chunk from pos: right after the first '\n' past chunk_bytes, or the end of the text
+static size_t cut_after(std::string_view text, size_t pos, size_t chunk_bytes) {
+    auto cut = text.find('\n', std::min(pos + chunk_bytes, text.size()));
+    return cut == std::string_view::npos ? text.size() : cut + 1;
+}
+
+CellColumns parse_columns_parallel(std::string_view text, size_t chunk_bytes) {
+    if (text.size() <= chunk_bytes) return parse_columns(text);
+    // [cuts[k], cuts[k + 1]) is chunk k
+    std::vector<size_t> cuts{0};
+    while (cuts.back() < text.size()) cuts.push_back(cut_after(text, cuts.back(), chunk_bytes));
+    auto K = cuts.size() - 1;
+    std::vector<CellColumns> parts(K);
+    std::vector<char> failed(K, 0);
+    std::vector<size_t> ks(K);
+    std::iota(ks.begin(), ks.end(), 0);
+    std::for_each(std::execution::par, ks.begin(), ks.end(), [&](size_t k) {
+        try {
+            parts[k] = parse_columns(text.substr(cuts[k], cuts[k + 1] - cuts[k]));
+        } catch (ParseError const&) {
+            failed[k] = 1;
+        }
+    });
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end()) return parse_columns(text);
+
+    // the rows and items of the chunks before k
+    std::vector<size_t> row_base(K + 1, 0), item_base(K + 1, 0);
+    for (size_t k = 0; k < K; ++k) {
+        row_base[k + 1] = row_base[k] + parts[k].size();
+        item_base[k + 1] = item_base[k] + parts[k].items();
+    }
+    CellColumns ret;
+    ret.loc.resize(row_base[K]);
+    ret.offset.resize(row_base[K] + 1);
+    ret.pci.resize(item_base[K]);
+    ret.rsrp.resize(item_base[K]);
+    ret.g5.resize(item_base[K]);
+    ret.offset[row_base[K]] = item_base[K];
+    std::for_each(std::execution::par, ks.begin(), ks.end(), [&](size_t k) {
+        auto& part = parts[k];
+        std::copy(part.loc.begin(), part.loc.end(), ret.loc.begin() + row_base[k]);
+        std::transform(part.offset.begin(), part.offset.end() - 1, ret.offset.begin() + row_base[k],
+                       [base = item_base[k]](size_t o) { return o + base; });
+        std::copy(part.pci.begin(), part.pci.end(), ret.pci.begin() + item_base[k]);
+        std::copy(part.rsrp.begin(), part.rsrp.end(), ret.rsrp.begin() + item_base[k]);
+        std::copy(part.g5.begin(), part.g5.end(), ret.g5.begin() + item_base[k]);
+        part = CellColumns();
+    });
+    return ret;
+}
+
+CellInfoStream::CellInfoStream(std::string_view text, std::shared_ptr<void const> storage,
+                               size_t chunk_bytes, size_t threads)
+    : text(text), storage(std::move(storage)), chunk_bytes(std::max<size_t>(chunk_bytes, 1)),
+      threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+bool CellInfoStream::parse_batch() {
+    if (pos >= text.size()) return false;
+    std::vector<size_t> cuts{pos};
+    while (cuts.size() <= threads && cuts.back() < text.size()) {
+        cuts.push_back(cut_after(text, cuts.back(), chunk_bytes));
+    }
+    auto K = cuts.size() - 1;
+    // the buffers of the previous batch are reused
+    batch.resize(K);
+    std::vector<size_t> lines(K, 0);
+    std::vector<char> failed(K, 0);
+    std::vector<size_t> ks(K);
+    std::iota(ks.begin(), ks.end(), 0);
+    std::for_each(std::execution::par, ks.begin(), ks.end(), [&](size_t k) {
+        batch[k].clear();
+        ColumnScanner scanner(text.substr(cuts[k], cuts[k + 1] - cuts[k]));
+        try {
+            while (scanner.next(batch[k])) {
+            }
+            lines[k] = scanner.line() - 1;
+        } catch (ParseError const&) {
+            failed[k] = 1;
+        }
+    });
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end()) {
+        // again in order from the line of the batch, for the error of its first bad row
+        ColumnScanner scanner(text.substr(pos, cuts[K] - pos), line);
+        CellColumns scratch;
+        while (scanner.next(scratch)) scratch.clear();
+    }
+    line += std::accumulate(lines.begin(), lines.end(), size_t(0));
+    pos = cuts[K];
+    return true;
+}
+
+bool CellInfoStream::advance() {
+    if (started) ++row;
+    started = true;
+    for (;;) {
+        for (; part < batch.size(); ++part, row = 0) {
+            if (row < batch[part].size()) return true;
+        }
+        if (!parse_batch()) return false;
+        part = row = 0;
+    }
+}
+
+CellInfoView CellInfoStream::current() const {
+    auto& c = batch[part];
+    auto b = c.offset[row], n = c.offset[row + 1] - b;
+    return {c.loc[row], {c.pci.data() + b, n}, {c.rsrp.data() + b, n}, {c.g5.data() + b, n}};
+}
+
+}  // namespace rxy
@@ -1,4 +1,6 @@
 #include "lexer.h"
+#include <charconv>
+#include <climits>
 #include <iostream>
 #include <sstream>
 
@@ -13,30 +15,50 @@ TokenPtr
     Token::R_A = std::make_shared<Token>(">"), 
     Token::G4 = std::make_shared<Token>("4G"), 
     Token::G5 = std::make_shared<Token>("5G"), 
-    Token::ENDL = std::make_shared<Token>("END of LINE", 1);
+    Token::ENDL = std::make_shared<Token>("END of LINE", 1),
+    Token::NUMBER = std::make_shared<Token>("number");
 
-double Lexer::next_number() {
-    int x = 0;
-    while (in.good() && is_digit(in.peek())) {
-        x *= 10;
-        x += (in.peek() - '0');
-        ++_col;
-        in.get();
+static constexpr size_t NUMBER_MAX = 64;
+
+void Lexer::take(char* buf, size_t& n) {
+    if (n == NUMBER_MAX) {
+        throw LexError("number too long at line " + std::to_string(_line) + ", col " + std::to_string(_col));
     }
+    buf[n++] = static_cast<char>(in.get());
+    ++_col;
+}
+
+/**
+ * digits [. digits] [e [+-] digits], gathered into a buffer and converted by from_chars (correctly
+ * rounded, no allocation)
+ * */
+double Lexer::next_number() {
+    char buf[NUMBER_MAX];
+    size_t n = 0;
+    while (in.good() && is_digit(in.peek())) take(buf, n);
     if (in.good() && in.peek() == '.') {
-        ++_col;
-        in.get();
-        double fraction = 0.;
-        while (in.good() && is_digit(in.peek())) {
-            fraction += (in.peek() - '0');
-            fraction /= 10.;
-            ++_col;
-            in.get();
+        take(buf, n);
+        while (in.good() && is_digit(in.peek())) take(buf, n);
+    }
+    if (in.good() && (in.peek() == 'e' || in.peek() == 'E')) {
+        take(buf, n);
+        if (in.good() && (in.peek() == '+' || in.peek() == '-')) take(buf, n);
+        if (!(in.good() && is_digit(in.peek()))) {
+            throw LexError("should be the digits of an exponent at line " + std::to_string(_line) + ", col " + std::to_string(_col));
         }
-        return x + fraction;
-    } else {
-        return x;
+        while (in.good() && is_digit(in.peek())) take(buf, n);
     }
+    double x = 0;
+    auto [_, ec] = std::from_chars(buf, buf + n, x);
+    if (ec != std::errc()) {
+        throw LexError("should be a number at line " + std::to_string(_line) + ", col " + std::to_string(_col));
+    }
+    return x;
+}
+
+static Numeric numeric(double x) {
+    bool integral = x >= INT_MIN && x <= INT_MAX && x == static_cast<int>(x);
+    return {integral ? Numeric::Tag::INT : Numeric::Tag::FLOAT, x};
 }
 
 void Lexer::next() {
@@ -44,6 +66,8 @@ void Lexer::next() {
         ++_col;
         in.get();
     }
+    _token_line = _line;
+    _token_col = _col;
     if (!in.good()) {
         token.reset();
         return;
@@ -62,30 +86,23 @@ void Lexer::next() {
             _col += 2;
         } else {
             in.putback(ch);
-            auto pos = _col;
-            double x = next_number();
-            if (x == (int)x) {
-                token = std::make_shared<Number>(x, _col - pos);
-            } else {
-                token = std::make_shared<Float>(x, _col - pos);
-            }
+            _number = numeric(next_number());
+            token = Token::NUMBER;
         }
         return;
     }
     if (in.peek() == '-') {
-        auto pos = _col;
         ++_col;
         in.get();
         while (in.good() && in.peek() == ' ') {
             ++_col;
             in.get();
         }
-        double x = next_number();
-        if (x == (int)x) {
-            token = std::make_shared<Number>(-x, _col - pos);
-        } else {
-            token = std::make_shared<Float>(-x, _col - pos);
+        if (!(in.good() && is_digit(in.peek()))) {
+            throw LexError("should be a number after '-' at line " + std::to_string(_line) + ", col " + std::to_string(_col));
         }
+        _number = numeric(-next_number());
+        token = Token::NUMBER;
         return;
     }
     char c;
@@ -0,0 +1,175 @@
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "parser.h"
+
+namespace rxy {
+
+/**
+ * @brief The rows of a CellInfo text as columns: row r is at location loc[r] and its items (pci,
+ * rsrp, 5G) are [offset[r], offset[r + 1]) of the item columns.
+ * */
+struct CellColumns {
+    std::vector<int> loc;
+    std::vector<size_t> offset{0};
+    std::vector<int> pci;
+    std::vector<double> rsrp;
+    std::vector<char> g5;
+
+    size_t size() const { return loc.size(); }
+
+    size_t items() const { return pci.size(); }
+
+    void clear() {
+        loc.clear();
+        offset.assign(1, 0);
+        pci.clear();
+        rsrp.clear();
+        g5.clear();
+    }
+
+    void reserve(size_t rows, size_t items) {
+        loc.reserve(rows);
+        offset.reserve(rows + 1);
+        pci.reserve(items);
+        rsrp.reserve(items);
+        g5.reserve(items);
+    }
+};
+
+/**
+ * @brief Parses the CellInfo grammar of Parser (`loc: [<pci, rsrp, 4G/5G>, ...]`, one row per line)
+ * straight from a buffer, typically a mapped file: no stream, no token objects, the values go to
+ * the columns. The errors are the ParseError of Parser, with the line and column of the buffer.
+ * */
+class ColumnScanner {
+   private:
+    char const* p;
+    char const* end;
+    char const* line_begin;
+    size_t _line;
+
+    // found: with the character at the error
+    [[noreturn]] void fail(std::string const& what, bool found = false) const;
+
+    void skip_blank() {
+        while (p != end && (*p == ' ' || *p == '\t')) ++p;
+    }
+
+    void newline();
+    void expect(char c);
+    bool scan_number(double& x);
+    int integer(char const* as);
+    double number();
+    void item(CellColumns& out);
+
+   public:
+    // first_line: the line number of the start of the text, for the errors
+    explicit ColumnScanner(std::string_view text, size_t first_line = 1)
+        : p(text.data()), end(text.data() + text.size()), line_begin(p), _line(first_line) {}
+
+    /**
+     * @brief appends the next row to out, the empty lines skipped.
+     * @return false at the end of the text
+     * @throws ParseError, out then holds a partial row
+     * */
+    bool next(CellColumns& out);
+
+    size_t line() const { return _line; }
+
+    size_t col() const { return static_cast<size_t>(p - line_begin) + 1; }
+};
+
+// all the rows of a text, see ColumnScanner
+CellColumns parse_columns(std::string_view text);
+
+/**
+ * @brief parse_columns by chunks of about chunk_bytes, cut at line ends and parsed in parallel,
+ * the rows concatenated in the order of the text. On an error the text is parsed again
+ * sequentially, so that the ParseError is the one of parse_columns: the first of the text, with
+ * its line.
+ * */
+CellColumns parse_columns_parallel(std::string_view text, size_t chunk_bytes = size_t(1) << 20);
+
+// a row of a CellInfoStream, borrowed from it
+struct CellInfoView {
+    int loc;
+    std::span<int const> pci;
+    std::span<double const> rsrp;
+    std::span<char const> g5;
+
+    size_t size() const { return pci.size(); }
+};
+
+/**
+ * @brief A single pass over the rows of a CellInfo text, one view at a time:
+ *
+ *     for (CellInfoView row : stream) ...
+ *
+ * The text is parsed by batches of `threads` chunks of about chunk_bytes, cut at line ends and
+ * parsed in parallel, so the memory is bounded by a batch whatever the size of the text, and the
+ * first rows are seen as soon as the first batch is parsed. A view is valid until the next row. A
+ * ParseError (the one of parse_columns, with its line) is thrown by the increment reaching the
+ * batch of the bad row: the rows before that batch have been seen.
+ * */
+class CellInfoStream {
+   private:
+    std::string_view text;
+    // keeps the text alive, e.g. its mapping
+    std::shared_ptr<void const> storage;
+    size_t chunk_bytes, threads;
+    // the start of the next batch and its line
+    size_t pos = 0, line = 1;
+    std::vector<CellColumns> batch;
+    // the current row: row of batch[part]
+    size_t part = 0, row = 0;
+    bool started = false;
+
+    bool parse_batch();
+    bool advance();
+
+   public:
+    class iterator {
+       private:
+        CellInfoStream* stream = nullptr;
+
+       public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = CellInfoView;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+
+        explicit iterator(CellInfoStream* stream) : stream(stream) {}
+
+        CellInfoView operator*() const { return stream->current(); }
+
+        iterator& operator++() {
+            if (!stream->advance()) stream = nullptr;
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const { return stream == nullptr; }
+    };
+
+    // threads: the chunks of a batch, 0 for the hardware concurrency
+    explicit CellInfoStream(std::string_view text, std::shared_ptr<void const> storage = nullptr,
+                            size_t chunk_bytes = size_t(1) << 20, size_t threads = 0);
+
+    // at the first row; a stream is iterated once
+    iterator begin() { return advance() ? iterator(this) : iterator(); }
+
+    std::default_sentinel_t end() const { return {}; }
+
+    CellInfoView current() const;
+};
+
+}  // namespace rxy
@@ -1,8 +1,12 @@
 #pragma once
+#include <cstdint>
 #include <istream>
 #include <memory>
 #include <string>
 
+// oneTBB, the backend of <execution>, defines ENDL for its version strings
+#undef ENDL
+
 namespace rxy {
 
 struct Token;
@@ -16,52 +20,57 @@ struct Token {
     Token(std::string&& str, int len) : str(std::move(str)), len(len) {}
     virtual ~Token() = default;
 
-    static TokenPtr DELIM, COLON, L_B, R_B, L_A, R_A, G4, G5, ENDL;
+    // NUMBER: the value is Lexer::number()
+    static TokenPtr DELIM, COLON, L_B, R_B, L_A, R_A, G4, G5, ENDL, NUMBER;
 };
 
-struct Number : public Token {
-    int value;
-    Number(int value, int len) : value(value) {this->len = len;}
-};
+// the value of a NUMBER token, an INT if it is integral and fits an int
+struct Numeric {
+    enum class Tag : uint8_t { INT, FLOAT };
+    Tag tag = Tag::INT;
+    double value = 0;
 
-struct Float : public Token {
-    double value;
-    Float(double value, int len) : value(value) {this->len = len;}
+    bool is_int() const { return tag == Tag::INT; }
+
+    int as_int() const { return static_cast<int>(value); }
 };
 
 struct LexError : public std::exception {
-    const char* reason;
-    LexError(std::string&& reason) noexcept : reason(reason.c_str()) {}
-    LexError(const char* reason) noexcept : reason(reason) {}
+    std::string reason;
+    LexError(std::string&& reason) noexcept : reason(std::move(reason)) {}
+    LexError(const char* reason) : reason(reason) {}
 
-    const char* what() const noexcept override { return reason; }
+    const char* what() const noexcept override { return reason.c_str(); }
 };
 
 class Lexer {
    private:
     TokenPtr token;
+    Numeric _number;
     // std::string const & str;
     std::istream& in;
     size_t _line;
     size_t _col;
+    // of the current token
+    size_t _token_line, _token_col;
+
+    bool is_digit(int c) { return c >= '0' && c <= '9'; }
 
-    bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    // appends the character to the number being read
+    void take(char* buf, size_t& n);
 
     double next_number();
 
    public:
-    Lexer(std::istream& in) : in(in), _line(1), _col(1) {}
+    Lexer(std::istream& in) : in(in), _line(1), _col(1), _token_line(1), _token_col(1) {}
     // Lexer(std::string const & str) : str(str), i(0), _line(1), _col(1) {}
     TokenPtr peek() const { return token; }
+    // the value of the current token if it is a NUMBER
+    Numeric const& number() const { return _number; }
     void next();
 
-    size_t line() const { return _line; }
-    size_t col() const {
-        if (token)
-            return _col - token->str.size();
-        else
-            return _col;
-    }
+    size_t line() const { return _token_line; }
+    size_t col() const { return _token_col; }
 };
 
 }  // namespace rxy
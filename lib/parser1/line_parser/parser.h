@@ -8,11 +8,11 @@
 namespace rxy {
 
 struct ParseError : std::exception {
-    const char* reason;
+    std::string reason;
     ParseError(const char* reason) : reason(reason) {}
-    ParseError(std::string&& reason) : reason(reason.c_str()) {}
+    ParseError(std::string&& reason) : reason(std::move(reason)) {}
 
-    const char* what() const noexcept override { return reason; }
+    const char* what() const noexcept override { return reason.c_str(); }
 };
 
 struct Info {
@@ -66,11 +66,13 @@ class Parser {
 
    public:
     bool parse() {
-        if (not lexer.peek()) {
-            std::cerr << "contain nothing" << std::endl;
-            return succ;
-        }
         try {
+            // the first token, read here so that its LexError is reported as the others
+            lexer.next();
+            if (not lexer.peek()) {
+                std::cerr << "contain nothing" << std::endl;
+                return succ;
+            }
             lines();
             succ = true;
         } catch (ParseError const& e) {
@@ -88,7 +90,7 @@ class Parser {
             throw std::runtime_error("parse failed");
     }
 
-    Parser(std::istream& in) : lexer(in), succ(false), pci(-1) { lexer.next(); }
+    Parser(std::istream& in) : lexer(in), succ(false), pci(-1) {}
 };
 
 }  // namespace rxy
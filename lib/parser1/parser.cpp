@@ -7,10 +7,9 @@ void Parser::line() {
         lexer.next();
         return;
     }
-    auto loc_tk = dynamic_cast<Number*>(lexer.peek().get());
-    if (loc_tk) {
+    if (lexer.peek() == Token::NUMBER && lexer.number().is_int()) {
         res.emplace_back();
-        res.back().loc = loc_tk->value;
+        res.back().loc = lexer.number().as_int();
     } else {
         throw ParseError("should be an integer (as location id) at line " + std::to_string(lexer.line()) + ", col " + std::to_string(lexer.col()));
     }
@@ -45,9 +44,8 @@ void Parser::items() {
 void Parser::item() {
     check(Token::L_A);
     lexer.next();
-    auto pci_tk = dynamic_cast<Number*>(lexer.peek().get());
-    if (pci_tk) {
-        pci = pci_tk->value;
+    if (lexer.peek() == Token::NUMBER && lexer.number().is_int()) {
+        pci = lexer.number().as_int();
     } else {
         throw ParseError("should be an integer (as pci) at line " + std::to_string(lexer.line()) + ", col " + std::to_string(lexer.col()));
     }
@@ -56,13 +54,10 @@ void Parser::item() {
     lexer.next();
     auto info = new Info();
     res.back().pci_info_list.emplace_back(pci, info);
-    auto rsrp_tk = lexer.peek().get();
-    if (Number* __tk = dynamic_cast<Number*>(rsrp_tk)) {
-        info->rsrp = __tk->value;
-    } else if (Float* __tk = dynamic_cast<Float*>(rsrp_tk)) {
-        info->rsrp = __tk->value;
+    if (lexer.peek() == Token::NUMBER) {
+        info->rsrp = lexer.number().value;
     } else {
-        throw ParseError("should be an integer (as rsrp) at line " + std::to_string(lexer.line()) + ", col " + std::to_string(lexer.col()));
+        throw ParseError("should be a number (as rsrp) at line " + std::to_string(lexer.line()) + ", col " + std::to_string(lexer.col()));
     }
     lexer.next();
     check(Token::DELIM);
@@ -4,6 +4,7 @@
 #include <exception>
 #include <fstream>
 #include <iterator>
+#include <limits>
 #include <stdexcept>
 #include <string>
 
@@ -50,6 +51,53 @@ private:
             ecc = obj.at("ecc").as_double();
         } catch (std::out_of_range &) {
         }
+        try {
+            stencil_markov = obj.at("stencilMarkov").as_bool();
+        } catch (std::out_of_range &) {
+        }
+        try {
+            beam_width = obj.at("beamWidth").as_int64();
+        } catch (std::out_of_range &) {
+        }
+        if (beam_width < 0)
+            throw std::runtime_error("wrong config for beamWidth: must be >= 0");
+        try {
+            auto num = obj.at("beamThreshold");
+            beam_threshold = num.is_double() ? num.as_double() : num.as_int64();
+        } catch (std::out_of_range &) {
+        }
+        if (!(beam_threshold >= 0))
+            throw std::runtime_error("wrong config for beamThreshold: must be >= 0");
+        try {
+            knn_index = obj.at("knnIndex").as_string().c_str();
+        } catch (std::out_of_range &) {
+        }
+        try {
+            knn_centroids = obj.at("knnCentroids").as_int64();
+        } catch (std::out_of_range &) {
+        }
+        try {
+            hnsw_m = obj.at("hnswM").as_int64();
+        } catch (std::out_of_range &) {
+        }
+        try {
+            hnsw_ef_construction = obj.at("hnswEfConstruction").as_int64();
+        } catch (std::out_of_range &) {
+        }
+        try {
+            hnsw_ef = obj.at("hnswEf").as_int64();
+        } catch (std::out_of_range &) {
+        }
+        if (hnsw_m <= 0)
+            throw std::runtime_error("wrong config for hnswM: must be > 0");
+        if (hnsw_ef_construction <= 0)
+            throw std::runtime_error("wrong config for hnswEfConstruction: must be > 0");
+        if (hnsw_ef < 0)
+            throw std::runtime_error("wrong config for hnswEf: must be >= 0");
+        try {
+            cache_dir = obj.at("cacheDir").as_string().c_str();
+        } catch (std::out_of_range &) {
+        }
         auto num = obj.at("d0");
         if (num.is_double())
             d0 = num.as_double();
@@ -74,6 +122,24 @@ public:
     int enumer_limit = 1000000000;
     int ext_rate = 5;
     double ecc = 0.1;
+    // build StencilMarkov instead of LocMarkov
+    bool stencil_markov = false;
+    // viterbi beam: the number of states kept per step (0: all), and the max distance to the best
+    // one in log probability
+    int beam_width = 0;
+    double beam_threshold = std::numeric_limits<double>::infinity();
+    // search of the KNN emission: "brute", "kd_tree" or "hnsw" (approximate); not "vp_tree", the
+    // inverse-weighted distance of the emission is not a metric
+    std::string knn_index = "brute";
+    // the k-means centroids kept per location of the KNN training data (0: all the rows)
+    int knn_centroids = 0;
+    // hnsw: the links per node, the candidate lists while building and while searching (0: top k),
+    // the larger the better the recall and the slower
+    int hnsw_m = 16;
+    int hnsw_ef_construction = 200;
+    int hnsw_ef = 0;
+    // the cache of the neighbour tables and transitions, relative to the project root (empty: none)
+    std::string cache_dir;
     double d0;
     std::string path;
     double noise;
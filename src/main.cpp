@@ -31,14 +31,15 @@ Point leftward = {-2, 0};
 Point rightward = {2, 0};
 Point stop = {0, 0};
 
-unordered_map<int, unordered_map<int, list<RSRP_TYPE>>> load_original_data(string const& file) {
-    unordered_map<int, unordered_map<int, list<RSRP_TYPE>>> loc_pci_map;
-    if (load_data(file, loc_pci_map)) {
+// the rsrp stats of every (location, pci) of a file, see MaxAPosteri
+unordered_map<int, unordered_map<int, RsrpStats>> load_original_data(string const& file) {
+    unordered_map<int, unordered_map<int, RsrpStats>> loc_pci_stats;
+    if (load_stats(file, loc_pci_stats)) {
         cout << "load data success" << endl;
     } else {
         cerr << "load data failed" << endl;
     }
-    return loc_pci_map;
+    return loc_pci_stats;
 }
 
 LocationMap load_loc_map() {
@@ -63,27 +64,25 @@ inline bool get_emission_prob_using_map(std::string const& file, LocationMap con
                                  MaxAPosteri const& max_a_posteri,
                                  std::vector<EmissionProb>& emission_probs,
                                  std::vector<LocationPtr>& locations, int T = -1) {
-    std::ifstream ifs(file);
-    Parser parser(ifs);
-    if (parser.parse()) {
-        if (T != -1) {
-            emission_probs.reserve(T);
-            locations.reserve(T);
-        }
-        for (auto&& cell_info : parser.get()) {
-            std::list<std::pair<int, RSRP_TYPE>> pci_rsrp_list;
-            for (auto&& [pci, info] : cell_info.pci_info_list) {
-                pci_rsrp_list.emplace_back(pci, info->rsrp);
-            }
-            locations.emplace_back(loc_map.get_loc(cell_info.loc));
-            emission_probs.emplace_back(max_a_posteri(pci_rsrp_list));
-        }
-    } else {
+    if (T != -1) {
+        emission_probs.reserve(T);
+        locations.reserve(T);
+    }
+    // the whole trace scored at once; nothing is added on a parse error
+    std::vector<std::list<std::pair<int, RSRP_TYPE>>> samples;
+    std::vector<LocationPtr> sample_locations;
+    if (!for_each_cell_info(file, [&](CellInfoView row) {
+            auto& pci_rsrp_list = samples.emplace_back();
+            for (size_t i = 0; i < row.size(); ++i) pci_rsrp_list.emplace_back(row.pci[i], row.rsrp[i]);
+            sample_locations.emplace_back(loc_map.get_loc(row.loc));
+        })) {
         std::cerr << "parse failed" << std::endl;
-        ifs.close();
         return false;
     }
-    ifs.close();
+    locations.insert(locations.end(), sample_locations.begin(), sample_locations.end());
+    for (auto&& emission_prob : max_a_posteri(samples)) {
+        emission_probs.emplace_back(std::move(emission_prob));
+    }
     return true;
 }
 
@@ -0,0 +1,173 @@
+#include "cache.hpp"
+#include <config.h>
+#include <configure.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <system_error>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace rxy {
+
+#ifdef _WIN32
+// no mapping: the file is read into memory once
+MappedFile::~MappedFile() { delete[] static_cast<std::byte const*>(ptr); }
+
+std::shared_ptr<MappedFile const> MappedFile::open(std::filesystem::path const& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return nullptr;
+    std::error_code ec;
+    auto n = std::filesystem::file_size(path, ec);
+    if (ec || n == 0) return nullptr;
+    auto buf = new std::byte[n];
+    if (!in.read(reinterpret_cast<char*>(buf), n)) {
+        delete[] buf;
+        return nullptr;
+    }
+    std::shared_ptr<MappedFile> ret(new MappedFile);
+    ret->ptr = buf;
+    ret->len = n;
+    return ret;
+}
+#else
+MappedFile::~MappedFile() {
+    if (ptr) munmap(const_cast<void*>(ptr), len);
+}
+
+std::shared_ptr<MappedFile const> MappedFile::open(std::filesystem::path const& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    auto p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (p == MAP_FAILED) return nullptr;
+    std::shared_ptr<MappedFile> ret(new MappedFile);
+    ret->ptr = p;
+    ret->len = static_cast<size_t>(st.st_size);
+    return ret;
+}
+#endif
+
+namespace cache {
+
+static constexpr uint64_t ALIGN = 64;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sections;
+    uint64_t key;
+};
+
+struct SectionEntry {
+    uint64_t offset, elem_size, count;
+};
+
+static uint64_t align(uint64_t n) { return (n + ALIGN - 1) / ALIGN * ALIGN; }
+
+std::filesystem::path path_of(std::string_view kind, uint64_t key) {
+    auto& dir = GetConfig().cache_dir;
+    if (dir.empty()) return {};
+    std::filesystem::path root(dir);
+    if (root.is_relative()) root = std::filesystem::path(ROOT_DIR) / root;
+    char name[32];
+    std::snprintf(name, sizeof(name), "_%016llx.bin", static_cast<unsigned long long>(key));
+    return root / (std::string(kind) + name);
+}
+
+bool Writer::write(std::filesystem::path const& path, uint64_t key, std::string_view magic, uint32_t version) const {
+    if (magic.size() != sizeof(Header::magic)) throw std::invalid_argument("cache: the magic is not of 8 characters");
+    if (path.empty()) return false;
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    auto tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+#ifdef DEBUG
+            std::cerr << "cache: can not write " << tmp << std::endl;
+#endif
+            return false;
+        }
+        Header header{};
+        std::copy(magic.begin(), magic.end(), header.magic);
+        header.version = version;
+        header.sections = static_cast<uint32_t>(sections.size());
+        header.key = key;
+        std::vector<SectionEntry> table;
+        uint64_t offset = align(sizeof(Header) + sections.size() * sizeof(SectionEntry));
+        for (auto& s : sections) {
+            table.push_back({offset, s.elem_size, s.count});
+            offset = align(offset + s.elem_size * s.count);
+        }
+        out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        out.write(reinterpret_cast<char const*>(table.data()), table.size() * sizeof(SectionEntry));
+        static constexpr char zeros[ALIGN] = {};
+        uint64_t pos = sizeof(Header) + table.size() * sizeof(SectionEntry);
+        for (size_t i = 0; i < sections.size(); ++i) {
+            out.write(zeros, table[i].offset - pos);
+            auto bytes = sections[i].elem_size * sections[i].count;
+            out.write(static_cast<char const*>(sections[i].data), bytes);
+            pos = table[i].offset + bytes;
+        }
+        if (!out) {
+#ifdef DEBUG
+            std::cerr << "cache: can not write " << tmp << std::endl;
+#endif
+            out.close();
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+Reader::Reader(std::filesystem::path const& path, uint64_t key, std::string_view magic, uint32_t version) {
+    if (path.empty() || magic.size() != sizeof(Header::magic)) return;
+    auto f = MappedFile::open(path);
+    if (!f || f->size() < sizeof(Header)) return;
+    Header header;
+    std::memcpy(&header, f->data(), sizeof(header));
+    if (std::memcmp(header.magic, magic.data(), sizeof(header.magic)) != 0 || header.version != version ||
+        header.key != key)
+        return;
+    auto table_end = sizeof(Header) + uint64_t(header.sections) * sizeof(SectionEntry);
+    if (table_end > f->size()) return;
+    sections.resize(header.sections);
+    std::memcpy(sections.data(), f->data() + sizeof(Header), header.sections * sizeof(SectionEntry));
+    for (auto& s : sections) {
+        if (s.offset % ALIGN != 0 || s.offset > f->size() || s.elem_size == 0 ||
+            s.count > (f->size() - s.offset) / s.elem_size) {
+            sections.clear();
+            return;
+        }
+    }
+    file = std::move(f);
+}
+
+}  // namespace cache
+
+}  // namespace rxy
@@ -0,0 +1,149 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace rxy {
+
+/**
+ * @brief A file mapped read-only into memory, unmapped with the last reference.
+ * */
+class MappedFile {
+   private:
+    void const* ptr = nullptr;
+    size_t len = 0;
+
+    MappedFile() = default;
+
+   public:
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+    ~MappedFile();
+
+    // nullptr if the file can not be opened or is empty
+    static std::shared_ptr<MappedFile const> open(std::filesystem::path const& path);
+
+    std::byte const* data() const { return static_cast<std::byte const*>(ptr); }
+
+    size_t size() const { return len; }
+};
+
+/**
+ * @brief FNV-1a of the bytes of trivially copyable values, for the cache keys.
+ * */
+class Hasher {
+   private:
+    uint64_t h = 14695981039346656037ull;
+
+   public:
+    Hasher& add(void const* data, size_t n) {
+        auto p = static_cast<unsigned char const*>(data);
+        for (size_t i = 0; i < n; ++i) {
+            h ^= p[i];
+            h *= 1099511628211ull;
+        }
+        return *this;
+    }
+
+    template <typename T>
+    requires std::is_trivially_copyable_v<T>
+    Hasher& operator()(T const& v) {
+        return add(&v, sizeof(T));
+    }
+
+    template <typename T>
+    Hasher& operator()(std::span<T const> v) {
+        (*this)(v.size());
+        return add(v.data(), v.size_bytes());
+    }
+
+    uint64_t value() const { return h; }
+};
+
+/**
+ * @brief Binary cache of derived arrays (neighbour tables, transitions), one file per key under
+ * the configured cache directory (cacheDir of conf.json, relative to the project root; disabled if
+ * empty). A file is a header (magic, version, key, number of sections), the table of its sections
+ * (offset, element size, count) and the sections, 64-byte aligned, so that they are used in place
+ * once the file is mapped. A file of another key or version, or a truncated one, is ignored.
+ * The same sectioned layout, under another magic and version, serves the other binary formats
+ * (see Fingerprints).
+ * */
+namespace cache {
+
+// bumped whenever what is cached or how it is computed changes
+inline constexpr uint32_t VERSION = 2;
+
+inline constexpr std::string_view MAGIC = "RXYCACHE";
+
+// the file of the key, empty if the cache is disabled
+std::filesystem::path path_of(std::string_view kind, uint64_t key);
+
+class Writer {
+   private:
+    struct Section {
+        void const* data;
+        uint64_t elem_size, count;
+    };
+    std::vector<Section> sections;
+
+   public:
+    // the data must outlive write()
+    template <typename T>
+    requires std::is_trivially_copyable_v<T>
+    Writer& add(std::span<T const> v) {
+        sections.push_back({v.data(), sizeof(T), v.size()});
+        return *this;
+    }
+
+    /**
+     * @brief writes the file of the key, through a temporary file renamed over it so that a reader
+     * never sees a partial one. Errors are only reported in DEBUG: the cache is an optimization.
+     * @return whether the file was written
+     * */
+    bool write(std::filesystem::path const& path, uint64_t key) const { return write(path, key, MAGIC, VERSION); }
+
+    // magic: 8 characters
+    bool write(std::filesystem::path const& path, uint64_t key, std::string_view magic, uint32_t version) const;
+};
+
+class Reader {
+   private:
+    std::shared_ptr<MappedFile const> file;
+    struct Section {
+        uint64_t offset, elem_size, count;
+    };
+    std::vector<Section> sections;
+
+   public:
+    // a reader over nothing if the file is missing or not of the key
+    Reader(std::filesystem::path const& path, uint64_t key) : Reader(path, key, MAGIC, VERSION) {}
+
+    // ... or not of the magic and version
+    Reader(std::filesystem::path const& path, uint64_t key, std::string_view magic, uint32_t version);
+
+    explicit operator bool() const { return file != nullptr; }
+
+    size_t size() const { return sections.size(); }
+
+    // the mapping, for the objects viewing the sections to keep it alive
+    std::shared_ptr<void const> storage() const { return file; }
+
+    template <typename T>
+    std::span<T const> section(size_t i) const {
+        auto& s = sections.at(i);
+        if (s.elem_size != sizeof(T)) throw std::runtime_error("cache: wrong element size");
+        return {reinterpret_cast<T const*>(file->data() + s.offset), s.count};
+    }
+};
+
+}  // namespace cache
+
+}  // namespace rxy
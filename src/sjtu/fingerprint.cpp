@@ -0,0 +1,132 @@
+#include "fingerprint.hpp"
+#include <algorithm>
+#include <set>
+#include <system_error>
+#include <unordered_map>
+
+#include "cache.hpp"
+
+namespace rxy {
+
+Fingerprints::Fingerprints(std::filesystem::path const& path) {
+    cache::Reader reader(path, 0, MAGIC, VERSION);
+    if (!reader || reader.size() != 7) return;
+    auto p = reader.section<int32_t>(0);
+    auto l = reader.section<int32_t>(1);
+    auto x = reader.section<float>(2);
+    auto t = reader.section<double>(3);
+    auto no = reader.section<uint64_t>(4);
+    auto nc = reader.section<char>(5);
+    auto src = reader.section<uint64_t>(6);
+    if (src.size() != 1) return;
+    if (x.size() != l.size() * p.size() || (!t.empty() && t.size() != l.size())) return;
+    if (!no.empty() && (no.front() != 0 || no.back() != nc.size() || !std::is_sorted(no.begin(), no.end()))) return;
+    // the labels of named samples index the names
+    if (!no.empty() && std::any_of(l.begin(), l.end(), [L = no.size() - 1](int32_t label) {
+            return label < 0 || static_cast<size_t>(label) >= L;
+        }))
+        return;
+    pcis = p;
+    label_column = l;
+    rsrp = x;
+    times = t;
+    name_offsets = no;
+    name_chars = nc;
+    source = src.front();
+    storage = reader.storage();
+}
+
+Fingerprints Fingerprints::of(std::filesystem::path const& data) {
+    if (data.extension() == EXTENSION) return Fingerprints(data);
+    // a directory given as "dir/" has the fingerprints "dir.fp"
+    auto path = data.has_filename() ? data : data.parent_path();
+    path.replace_extension(EXTENSION);
+    if (!std::filesystem::exists(path)) return {};
+    Fingerprints ret(path);
+    // the mtime of a directory does not change when a sheet is edited in place: the sources are compared
+    auto sign = signature(data);
+    if (!ret || sign == 0 || ret.source != sign) return {};
+    return ret;
+}
+
+uint64_t Fingerprints::signature(std::filesystem::path const& data) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    Hasher hasher;
+    auto add = [&hasher, &ec](fs::path const& file) {
+        auto size = static_cast<uint64_t>(fs::file_size(file, ec));
+        if (ec) return false;
+        auto mtime = static_cast<int64_t>(fs::last_write_time(file, ec).time_since_epoch().count());
+        if (ec) return false;
+        hasher(size)(mtime);
+        return true;
+    };
+    if (!fs::is_directory(data, ec)) return add(data) ? hasher.value() : 0;
+    // the sheets read by the loaders, in name order
+    std::vector<fs::path> sheets;
+    for (auto const& entry : fs::directory_iterator(data, ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".xlsx") sheets.push_back(entry.path());
+    }
+    if (ec) return 0;
+    std::sort(sheets.begin(), sheets.end());
+    for (auto& sheet : sheets) {
+        auto name = sheet.filename().string();
+        hasher(std::span<char const>(name));
+        if (!add(sheet)) return 0;
+    }
+    return hasher.value();
+}
+
+int32_t Fingerprints::Builder::label_of(std::string const& name) {
+    auto it = std::find(names.begin(), names.end(), name);
+    if (it != names.end()) return static_cast<int32_t>(it - names.begin());
+    names.push_back(name);
+    return static_cast<int32_t>(names.size() - 1);
+}
+
+void Fingerprints::Builder::add(int label, std::span<int const> pci, std::span<double const> rsrp,
+                                double timestamp) {
+    if (pci.size() != rsrp.size()) throw std::invalid_argument("pci.size() != rsrp.size()");
+    label_column.push_back(label);
+    times.push_back(timestamp);
+    item_pci.insert(item_pci.end(), pci.begin(), pci.end());
+    for (auto v : rsrp) item_rsrp.push_back(static_cast<float>(v));
+    offset.push_back(item_pci.size());
+}
+
+bool Fingerprints::Builder::write(std::filesystem::path const& path, uint64_t source) const {
+    std::vector<int32_t> pci_order(order.begin(), order.end());
+    std::set<int32_t> others(item_pci.begin(), item_pci.end());
+    for (auto pci : order) others.erase(pci);
+    pci_order.insert(pci_order.end(), others.begin(), others.end());
+    std::unordered_map<int32_t, size_t> column;
+    for (size_t j = 0; j < pci_order.size(); ++j) column.emplace(pci_order[j], j);
+
+    auto N = label_column.size(), P = pci_order.size();
+    std::vector<float> dense(N * P, MISSING);
+    for (size_t r = 0; r < N; ++r) {
+        for (auto i = offset[r]; i < offset[r + 1]; ++i) dense[r * P + column.at(item_pci[i])] = item_rsrp[i];
+    }
+    std::vector<double> timestamps;
+    if (std::any_of(times.begin(), times.end(), [](double t) { return !std::isnan(t); })) timestamps = times;
+    std::vector<uint64_t> name_offsets;
+    std::string name_chars;
+    if (!names.empty()) {
+        name_offsets.push_back(0);
+        for (auto& name : names) {
+            name_chars += name;
+            name_offsets.push_back(name_chars.size());
+        }
+    }
+    return cache::Writer()
+        .add(std::span<int32_t const>(pci_order))
+        .add(std::span<int32_t const>(label_column))
+        .add(std::span<float const>(dense))
+        .add(std::span<double const>(timestamps))
+        .add(std::span<uint64_t const>(name_offsets))
+        .add(std::span<char const>(name_chars))
+        .add(std::span<uint64_t const>(&source, 1))
+        .write(path, 0, MAGIC, VERSION);
+}
+
+}  // namespace rxy
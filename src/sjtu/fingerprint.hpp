@@ -0,0 +1,150 @@
+#pragma once
+#include <configure.hpp>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rxy {
+
+/**
+ * @brief A binary fingerprint file: the rsrp of every sample as a float32 row over the pci order of
+ * the file, NaN where the pci was not measured, with the label of the sample and optionally its
+ * timestamp. Laid out as the cache files (sections of a mapped file, see cache), so that it is used
+ * in place with no parsing:
+ *     pci_order int32[P] | labels int32[N] | rsrp float32[N x P] | timestamps float64[N or 0]
+ *     | name offsets uint64[L + 1 or 0] | name characters | source uint64[1]
+ * The labels are the location ids of a CellInfo text, or the indices of the names of the samples
+ * of xlsx sheets (their file names). The source is the signature() of the data it was converted
+ * from, so that an edited input is read again. Written by the fingerprint_convert tool, see Builder.
+ * */
+class Fingerprints {
+   private:
+    std::shared_ptr<void const> storage;
+    std::span<int32_t const> pcis;
+    std::span<int32_t const> label_column;
+    std::span<float const> rsrp;
+    std::span<double const> times;
+    std::span<uint64_t const> name_offsets;
+    std::span<char const> name_chars;
+    uint64_t source = 0;
+
+   public:
+    // bumped whenever the layout changes
+    static constexpr uint32_t VERSION = 2;
+
+    static constexpr std::string_view MAGIC = "RXYFPRNT";
+
+    static constexpr char const* EXTENSION = ".fp";
+
+    static constexpr float MISSING = std::numeric_limits<float>::quiet_NaN();
+
+    Fingerprints() = default;
+
+    // a reader over nothing if the file is missing, not a fingerprint file of this version or corrupt
+    explicit Fingerprints(std::filesystem::path const& path);
+
+    /**
+     * @brief the fingerprints of a data file (CellInfo text, directory of xlsx sheets): the file
+     * itself if it is a fingerprint file, else its sibling of the EXTENSION if that was converted
+     * from the data as it is now (same signature); a reader over nothing otherwise.
+     * */
+    static Fingerprints of(std::filesystem::path const& data);
+
+    /**
+     * @brief the size and modification time of a data file, or of the xlsx sheets of a directory
+     * (with their names), hashed; 0 if they can not be read.
+     * */
+    static uint64_t signature(std::filesystem::path const& data);
+
+    explicit operator bool() const { return storage != nullptr; }
+
+    size_t size() const { return label_column.size(); }
+
+    std::span<int32_t const> pci_order() const { return pcis; }
+
+    std::span<int32_t const> labels() const { return label_column; }
+
+    std::span<float const> row(size_t r) const { return rsrp.subspan(r * pcis.size(), pcis.size()); }
+
+    bool has_timestamps() const { return !times.empty(); }
+
+    std::span<double const> timestamps() const { return times; }
+
+    bool has_names() const { return !name_offsets.empty(); }
+
+    // throws std::out_of_range if the label has no name
+    std::string_view name(int32_t label) const {
+        if (label < 0 || static_cast<size_t>(label) + 1 >= name_offsets.size())
+            throw std::out_of_range("Fingerprints: no name for label " + std::to_string(label));
+        return {name_chars.data() + name_offsets[label], name_offsets[label + 1] - name_offsets[label]};
+    }
+
+    // the column of every pci of pci_order, -1 if the file has none
+    template <typename Container>
+    std::vector<int> columns(Container const& pci_order) const {
+        std::vector<int> ret;
+        ret.reserve(pci_order.size());
+        for (auto pci : pci_order) {
+            int c = -1;
+            for (size_t j = 0; j < pcis.size(); ++j) {
+                if (pcis[j] == pci) {
+                    c = static_cast<int>(j);
+                    break;
+                }
+            }
+            ret.push_back(c);
+        }
+        return ret;
+    }
+
+    // row r over the pci order of columns (see columns()) into out, default_rsrp where not measured
+    void align(size_t r, std::vector<int> const& columns, RSRP_TYPE default_rsrp, RSRP_TYPE* out) const {
+        auto x = row(r);
+        for (size_t i = 0; i < columns.size(); ++i) {
+            auto c = columns[i];
+            out[i] = c < 0 || std::isnan(x[c]) ? default_rsrp : static_cast<RSRP_TYPE>(x[c]);
+        }
+    }
+
+    /**
+     * @brief Collects the samples of a fingerprint file. The columns are the given pci order, then
+     * the other pcis met, sorted.
+     * */
+    class Builder {
+       private:
+        std::vector<int> order;
+        std::vector<int32_t> label_column;
+        std::vector<double> times;
+        std::vector<std::string> names;
+        // the samples, sparse until written: the items of sample r are [offset[r], offset[r + 1])
+        std::vector<size_t> offset{0};
+        std::vector<int32_t> item_pci;
+        std::vector<float> item_rsrp;
+
+       public:
+        explicit Builder(std::vector<int> pci_order = {}) : order(std::move(pci_order)) {}
+
+        size_t size() const { return label_column.size(); }
+
+        // the label of a name, added if new
+        int32_t label_of(std::string const& name);
+
+        void add(int label, std::span<int const> pci, std::span<double const> rsrp,
+                 double timestamp = std::numeric_limits<double>::quiet_NaN());
+
+        /**
+         * @param source: the signature() of the data converted, 0 if unknown: the file is then
+         * only read when given explicitly. The timestamps are written if any sample has one.
+         * */
+        bool write(std::filesystem::path const& path, uint64_t source = 0) const;
+    };
+};
+
+}  // namespace rxy
@@ -0,0 +1,92 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace rxy {
+
+/**
+ * @brief Shortest path (geodesic) distances on an m x n grid of cells, 8-connected: an axial step
+ * costs the step along its axis, a diagonal one the diagonal of a cell. The removed cells are
+ * obstacles, and a diagonal step may not cut the corner of one. The distances from a source are
+ * found by Dijkstra, bounded by a max distance, so a search only touches its own neighbourhood;
+ * the scratch is per thread, so the sources can be searched in parallel.
+ * */
+class GridGeodesic {
+   private:
+    static constexpr int dx[] = {0, 1, 0, -1, 1, 1, -1, -1};
+    static constexpr int dy[] = {1, 0, -1, 0, 1, -1, 1, -1};
+
+    int m = 0, n = 0;
+    double edge[8] = {};
+    // cell (i * n + j) -> not removed
+    std::vector<char> free;
+
+    // the distances of the cells reached by the current search, valid where the tag is current
+    struct Scratch {
+        std::vector<double> dist;
+        std::vector<uint32_t> tags;
+        uint32_t tag = 0;
+        std::vector<std::pair<double, int>> heap;
+
+        void reset(size_t cells) {
+            if (tags.size() < cells) {
+                tags.resize(cells, 0);
+                dist.resize(cells);
+            }
+            if (++tag == 0) {
+                std::fill(tags.begin(), tags.end(), 0);
+                tag = 1;
+            }
+            heap.clear();
+        }
+    };
+
+   public:
+    GridGeodesic() = default;
+
+    GridGeodesic(int m, int n, double x_step, double y_step, std::vector<char> free)
+        : m(m), n(n), free(std::move(free)) {
+        double diagonal = std::sqrt(x_step * x_step + y_step * y_step);
+        for (int k = 0; k < 8; ++k) edge[k] = dx[k] && dy[k] ? diagonal : dx[k] ? x_step : y_step;
+    }
+
+    /**
+     * @brief calls visit(cell, distance) once for every cell within max_dist of the free cell src,
+     * src included, nearest first.
+     * */
+    template <class Visit>
+    void search(int src, double max_dist, Visit&& visit) const {
+        thread_local Scratch s;
+        s.reset(free.size());
+        auto relax = [](int cell, double d) {
+            if (s.tags[cell] == s.tag && s.dist[cell] <= d) return;
+            s.tags[cell] = s.tag;
+            s.dist[cell] = d;
+            s.heap.emplace_back(d, cell);
+            std::push_heap(s.heap.begin(), s.heap.end(), std::greater<>());
+        };
+        relax(src, 0);
+        while (!s.heap.empty()) {
+            std::pop_heap(s.heap.begin(), s.heap.end(), std::greater<>());
+            auto [d, c] = s.heap.back();
+            s.heap.pop_back();
+            // settled before through a shorter path
+            if (d > s.dist[c]) continue;
+            visit(c, d);
+            int a = c / n, b = c % n;
+            for (int k = 0; k < 8; ++k) {
+                int x = a + dx[k], y = b + dy[k];
+                if (x < 0 || x >= m || y < 0 || y >= n || !free[x * n + y]) continue;
+                if (dx[k] && dy[k] && !(free[a * n + y] && free[x * n + b])) continue;
+                auto nd = d + edge[k];
+                if (nd <= max_dist) relax(x * n + y, nd);
+            }
+        }
+    }
+};
+
+}  // namespace rxy
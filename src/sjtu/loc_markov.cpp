@@ -1,9 +1,10 @@
 #include "loc_markov.hpp"
+#include "cache.hpp"
 #include "hmm/location.hpp"
 #include "hmm/probability.hpp"
 #include <configure.hpp>
 #include <execution>
-#include <limits>
+#include <numeric>
 #include <stdexcept>
 
 #ifdef DEBUG
@@ -14,41 +15,66 @@ namespace rxy {
 
 void LocMarkov::__init() {
     auto &delta = sense.delta();
-    auto N = loc_map.get_ext_dict().size();
-    _tran_prob.reserve(N);
-
-    auto const &ls = loc_map.get_ext_list();
-    for (auto &&loc : ls) {
-        auto &t = _tran_prob[loc];
-        for (auto &&l : ls)
-            t[l] = Prob::ZERO;
+    index = loc_map.get_state_index();
+    auto &ls = *index;
+    auto N = ls.size();
+
+    // the transitions of the same map and sensation, cached by an earlier run
+    auto key = Hasher()(loc_map.cache_key())(delta.x())(delta.y()).value();
+    auto path = cache::path_of("loc_markov", key);
+    if (cache::Reader reader(path, key); reader && reader.size() == 6) {
+        try {
+            _tran_prob = SparseTransition(
+                N,
+                {reader.section<size_t>(0), reader.section<uint32_t>(1),
+                 reader.section<Prob::value_type>(2), reader.section<size_t>(3),
+                 reader.section<uint32_t>(4), reader.section<Prob::value_type>(5)},
+                reader.storage());
+            return;
+        } catch (std::exception &) {
+            // not of this map after all: computed again
+        }
     }
+
+    // out_edges[src]: the reachable destinations of src, only those are stored
+    std::vector<std::vector<std::pair<uint32_t, Prob::value_type>>> out_edges(N);
+    std::vector<uint32_t> srcs(N);
+    std::iota(srcs.begin(), srcs.end(), 0);
+    auto cells = loc_map.state_handles();
     std::for_each(
-        std::execution::par_unseq, ls.begin(), ls.end(),
-        [this, &delta, &ls](LocationPtr loc) {
-            Point new_point = loc->point + delta;
-            LocationPtr new_loc;
-            if (!loc_map.check(new_point) ||
-                !(new_loc = loc_map.get_ext_loc(new_point))) {
-                return;
-            }
+        std::execution::par_unseq, srcs.begin(), srcs.end(),
+        [this, &delta, cells, &out_edges](uint32_t src) {
+            auto point = loc_map.ext_point(cells[src]);
+            auto target = loc_map.ext_handle(point + delta);
+            if (target == LocationMap::NO_EXT) return;
 
-            for (auto &&dest : ls) {
-                try {
-                    auto dist = loc_map.distance(new_loc, dest);
-                    if (dist != std::numeric_limits<double>::infinity() &&
-                        dist < 1.5 * minkowski(loc->point, new_loc->point)) {
-                        _tran_prob[dest][loc] = log_nd_pdf(dist);
-                    }
-                } catch (std::out_of_range &) {
-                    continue;
+            // only the ext locations within d0 of the target can be reached
+            // compared in float, as the distances are stored: a distance on the radius stays out
+            auto radius = static_cast<float>(1.5 * minkowski(point, loc_map.ext_point(target)));
+            auto from = loc_map.state_of(target);
+            auto dsts = loc_map.neighbours(from);
+            auto dists = loc_map.neighbour_distances(from);
+            auto &edges = out_edges[src];
+            for (size_t k = 0; k < dsts.size(); ++k) {
+                if (dists[k] < radius) {
+                    edges.emplace_back(dsts[k], log_nd_pdf(dists[k]).prob);
                 }
             }
         });
+    _tran_prob = SparseTransition(N, out_edges);
+    auto arrays = _tran_prob.arrays();
+    cache::Writer()
+        .add(arrays.row_ptr)
+        .add(arrays.src)
+        .add(arrays.log_prob)
+        .add(arrays.col_ptr)
+        .add(arrays.dst)
+        .add(arrays.col_log_prob)
+        .write(path, key);
 
 #ifdef DEBUG
     std::cout << "Markov trans prob DONE." << std::endl;
 #endif
 }
 
-} // namespace rxy
\ No newline at end of file
+} // namespace rxy
@@ -1,13 +1,14 @@
 #include "location_map.hpp"
+#include "cache.hpp"
+#include "geodesic.hpp"
 #include "hmm/location.hpp"
+#include <algorithm>
+#include <execution>
 #include <limits>
 #include <mutex>
-#include <queue>
+#include <numeric>
 
 namespace rxy {
-static constexpr int dx[] = {0, 1, 0, -1, 1, 1, -1, -1};
-static constexpr int dy[] = {1, 0, -1, 0, 1, -1, 1, -1};
-
 static std::mutex mtx;
 
 void LocationMap::compute_distance() const {
@@ -15,80 +16,92 @@ void LocationMap::compute_distance() const {
     std::lock_guard<std::mutex> lk(mtx);
     if (computed) return;
 
+#ifdef DEBUG
     std::cout << "compute distance start" << std::endl;
-    
-    const double sqrt2 =
-        sqrt(x_step_ext * x_step_ext + y_step_ext * y_step_ext);
-    const double edge[] = {y_step_ext, x_step_ext, y_step_ext, x_step_ext,
-                           sqrt2,      sqrt2,      sqrt2,      sqrt2};
-
-    std::vector<std::vector<std::vector<std::vector<double>>>> dist(
-        m_ext,
-        std::vector<std::vector<std::vector<double>>>(
-            n_ext,
-            std::vector<std::vector<double>>(
-                m_ext, std::vector<double>(
-                           n_ext, std::numeric_limits<double>::infinity()))));
+#endif
 
-    auto dd = GetConfig().d0;
-    {
-        std::vector<std::vector<bool>> computed(
-            m_ext, std::vector<bool>(n_ext, false));
-        std::vector<std::vector<bool>> vis(m_ext,
-                                           std::vector<bool>(n_ext, false));
-        std::queue<std::pair<int, int>> q;
-        for (int i = 0; i < m_ext; ++i) {
-            for (int j = 0; j < n_ext; ++j) {
-                if (!ext_map[i][j])
-                    continue;
-                for (auto &&tt : vis)
-                    std::fill(tt.begin(), tt.end(), false);
-                vis[i][j] = true;
-                q.emplace(i, j);
-                auto &d = dist[i][j];
-                d[i][j] = 0;
-                while (!q.empty()) {
-                    auto [a, b] = q.front();
-                    q.pop();
-                    auto d0 = d[a][b];
-                    if (d0 > dd) {
-                        continue;
-                    }
-                    for (int k = 0; k < 8; ++k) {
-                        int x = a + dx[k], y = b + dy[k];
-                        if (x >= 0 && x < m_ext && y >= 0 && y < n_ext &&
-                            ext_map[x][y] && !vis[x][y] && !computed[x][y]) {
-                            vis[x][y] = true;
-                            d[x][y] = dist[x][y][i][j] = d0 + edge[k];
-                            q.emplace(x, y);
-                        }
-                    }
-                }
-                computed[i][j] = true;
-            }
+    auto key = cache_key();
+    auto path = cache::path_of("neighbours", key);
+    if (cache::Reader reader(path, key); reader && reader.size() == 3) {
+        neighbour_offset = reader.section<uint32_t>(0);
+        neighbour_index = reader.section<uint32_t>(1);
+        neighbour_dist = reader.section<float>(2);
+        auto N = get_state_index()->size();
+        // the markovs and the stencil index with them unchecked: a corrupt file is recomputed
+        if (neighbour_offset.size() == N + 1 && neighbour_offset[0] == 0 &&
+            neighbour_offset[N] == neighbour_index.size() && neighbour_index.size() == neighbour_dist.size() &&
+            std::is_sorted(neighbour_offset.begin(), neighbour_offset.end()) &&
+            std::all_of(neighbour_index.begin(), neighbour_index.end(), [N](uint32_t l) { return l < N; })) {
+            neighbour_storage = reader.storage();
+            computed = true;
+            return;
         }
     }
 
-    for (size_t i = 0; i < m_ext; ++i) {
-        for (size_t j = 0; j < n_ext; ++j) {
-            // std::cout << i << ',' << j << '\n';
-            auto x = ext_map[i][j];
-            if (!x)
-                continue;
-            auto &dmx = dist_map[x];
-            auto const &d = dist[i][j];
-            for (size_t a = 0; a < m_ext; ++a) {
-                for (size_t b = 0; b < n_ext; ++b) {
-                    auto y = ext_map[a][b];
-                    if (!y || d[a][b] > dd)
-                        continue;
-                    dmx[y] = d[a][b];
-                }
-            }
+    auto dd = GetConfig().d0;
+    struct Vectors {
+        std::vector<uint32_t> neighbour_offset, neighbour_index;
+        std::vector<float> neighbour_dist;
+    };
+    auto v = std::make_shared<Vectors>();
+
+    auto cells = state_handles();
+    auto &cell_state = handle_state;
+    uint32_t N = static_cast<uint32_t>(cells.size());
+    std::vector<char> free(ext_view.size());
+    for (ExtHandle h = 0; h < free.size(); ++h) free[h] = occupied(h);
+    GridGeodesic geodesic(m_ext, n_ext, x_step_ext, y_step_ext, std::move(free));
+
+    // one bounded Dijkstra per source; the sources are independent so they run in parallel
+    std::vector<std::vector<std::pair<uint32_t, Point::value_type>>> rows(N);
+    std::vector<uint32_t> srcs(N);
+    std::iota(srcs.begin(), srcs.end(), 0);
+    std::for_each(std::execution::par, srcs.begin(), srcs.end(),
+                  [&geodesic, &cell_state, cells, &rows, dd](uint32_t src) {
+                      auto &row = rows[src];
+                      geodesic.search(cells[src], dd, [&cell_state, &row](int c, double d) {
+                          row.emplace_back(cell_state[c], d);
+                      });
+                      std::sort(row.begin(), row.end());
+                  });
+
+    auto &offset = v->neighbour_offset;
+    offset.assign(N + 1, 0);
+    for (uint32_t s = 0; s < N; ++s) {
+        offset[s + 1] = offset[s] + static_cast<uint32_t>(rows[s].size());
+    }
+    v->neighbour_index.resize(offset[N]);
+    v->neighbour_dist.resize(offset[N]);
+    for (uint32_t s = 0; s < N; ++s) {
+        auto k = offset[s];
+        for (auto [dst, d] : rows[s]) {
+            v->neighbour_index[k] = dst;
+            v->neighbour_dist[k++] = static_cast<float>(d);
         }
+        std::vector<std::pair<uint32_t, Point::value_type>>().swap(rows[s]);
     }
+    neighbour_offset = v->neighbour_offset;
+    neighbour_index = v->neighbour_index;
+    neighbour_dist = v->neighbour_dist;
+    neighbour_storage = std::move(v);
+    cache::Writer()
+        .add(neighbour_offset)
+        .add(neighbour_index)
+        .add(neighbour_dist)
+        .write(path, key);
+#ifdef DEBUG
     std::cout << "compute_distance()" << std::endl;
+#endif
     computed = true;
 }
 
+uint64_t LocationMap::cache_key() const {
+    Hasher h;
+    h(m)(n)(left_down.x())(left_down.y())(right_up.x())(right_up.y());
+    h(GetConfig().ext_rate)(GetConfig().d0)(static_cast<double>(ND_MU))(static_cast<double>(ND_SIGMA));
+    // the removed ext cells
+    h(std::span<uint64_t const>(ext_occupied));
+    return h.value();
+}
+
 } // namespace rxy
@@ -1,8 +1,12 @@
 #pragma once
 #include <configure.hpp>
-#include <list>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <span>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #ifdef DEBUG
@@ -13,17 +17,24 @@
 #include "ext_loc.hpp"
 #include "hmm/location.hpp"
 #include "hmm/probability.hpp"
+#include "hmm/state_index.hpp"
 
 namespace rxy {
 
 class LocationMap {
+   public:
+    // an ext cell: i * n_ext + j
+    using ExtHandle = uint32_t;
+    static constexpr ExtHandle NO_EXT = LocKey::NO_EXT;
+
    private:
     int m, n;
-    std::vector<std::vector<LocationPtr>> loc_map;
-    std::vector<std::vector<LocationPtr>> ext_map;
+    // coarse cell (i * n + j) -> location, nullptr if none
+    std::vector<LocationPtr> loc_map;
     // loc_id -> (i, j)
     std::unordered_map<int, std::pair<int, int>> loc_dict;
-    std::list<LocationPtr> loc_set;
+    // in the order they were added
+    std::vector<LocationPtr> loc_list;
 
     Point left_down, right_up;
     Point::value_type x_step, y_step;
@@ -32,14 +43,33 @@ class LocationMap {
     Point::value_type x_step_ext, y_step_ext;
     Point::value_type x_ratio_ext, y_ratio_ext;
     int m_ext, n_ext;
-    std::unordered_map<LocationPtr, std::pair<int, int>> ext_dict;
-    std::unordered_set<LocationPtr> ext_set;
+    // the ext cells, by handle: the center, the id of the coarse location, whether it is on the
+    // map (a bit per cell); the hot loops only read these
+    std::vector<Point::value_type> ext_x, ext_y;
+    std::vector<int> ext_coarse;
+    std::vector<uint64_t> ext_occupied;
+    // the LocationPtr of every cell on the map, for the API taking locations
+    std::vector<LocationPtr> ext_view;
+    size_t ext_count = 0;
 
     Prob::value_type sigma;
 
+    // dense index of the ext locations in grid order, and state <-> handle, rebuilt after the map
+    // is modified
+    mutable StateIndexPtr state_index;
+    mutable std::vector<ExtHandle> state_handle;
+    // NO_STATE if the cell is not on the map
+    mutable std::vector<uint32_t> handle_state;
+
+    // the neighbour table, cleared after the map is modified
     mutable bool computed = false;
-    mutable std::unordered_map<LocationPtr, std::unordered_map<LocationPtr, Point::value_type>>
-        dist_map;
+    // keeps the arrays of the table alive: vectors of its own, or a mapped cache file
+    mutable std::shared_ptr<void const> neighbour_storage;
+    // the ext locations within d0 of every ext location, by state index (CSR): the neighbours of
+    // src are neighbour_index / neighbour_dist[neighbour_offset[src], neighbour_offset[src + 1]),
+    // sorted by index
+    mutable std::span<uint32_t const> neighbour_offset, neighbour_index;
+    mutable std::span<float const> neighbour_dist;
 
     void __init() {
         if (!(m > 1 && m <= GetConfig().map_size && n > 1 && n <= GetConfig().map_size))
@@ -54,19 +84,46 @@ class LocationMap {
         y_ratio = 1.0 / y_step;
         sigma = ND_SIGMA * std::max(x_step, y_step);
 
+        loc_map.resize(m * n);
         loc_dict.reserve(m * n);
 
         x_step_ext = x_step / GetConfig().ext_rate, y_step_ext = y_step / GetConfig().ext_rate;
         x_ratio_ext = 1.0 / x_step_ext, y_ratio_ext = 1.0 / y_step_ext;
 
         m_ext = m * GetConfig().ext_rate, n_ext = n * GetConfig().ext_rate;
-        ext_map.resize(m_ext, std::vector<LocationPtr>(n_ext));
-        ext_dict.reserve(m_ext * n_ext);
+        auto cells = static_cast<size_t>(m_ext) * n_ext;
+        ext_x.resize(cells);
+        ext_y.resize(cells);
+        for (int i = 0; i < m_ext; ++i) {
+            for (int j = 0; j < n_ext; ++j) {
+                ext_x[i * n_ext + j] = left_down.x() + i * x_step_ext + x_step_ext / 2;
+                ext_y[i * n_ext + j] = left_down.y() + j * y_step_ext + y_step_ext / 2;
+            }
+        }
+        ext_coarse.assign(cells, -1);
+        ext_occupied.assign((cells + 63) / 64, 0);
+        ext_view.resize(cells);
+    }
 
-        dist_map.reserve(m_ext * n_ext);
+    // the map changed: the index and the neighbour table are rebuilt on demand
+    void modified() {
+        state_index.reset();
+        computed = false;
+    }
+
+    void remove_ext(int i, int j) {
+        if (i < 0 || i >= m_ext || j < 0 || j >= n_ext) throw std::out_of_range("ext cell out of the map");
+        auto h = ext_handle(i, j);
+        if (!occupied(h)) return;
+        ext_occupied[h >> 6] &= ~(uint64_t(1) << (h & 63));
+        ext_view[h].reset();
+        --ext_count;
+        modified();
     }
 
    public:
+    static constexpr uint32_t NO_STATE = std::numeric_limits<uint32_t>::max();
+
     bool check(int i, int j) const { return i >= 0 && i < m && j >= 0 && j < n; }
 
     bool check(LocationPtr loc) const { return loc != nullptr && check(loc->point); }
@@ -77,20 +134,12 @@ class LocationMap {
     }
 
     LocationMap(int m, int n, Point const& left_down, Point const& right_up)
-        : m(m),
-          n(n),
-          loc_map(m, std::vector<LocationPtr>(n)),
-          left_down(left_down),
-          right_up(right_up) {
+        : m(m), n(n), left_down(left_down), right_up(right_up) {
         __init();
     }
 
     LocationMap(int m, int n, Point&& left_down, Point&& right_up)
-        : m(m),
-          n(n),
-          loc_map(m, std::vector<LocationPtr>(n)),
-          left_down(std::move(left_down)),
-          right_up(std::move(right_up)) {
+        : m(m), n(n), left_down(std::move(left_down)), right_up(std::move(right_up)) {
         __init();
     }
 
@@ -104,28 +153,27 @@ class LocationMap {
 
     bool add_loc(int i, int j, int id = -1) {
         if (!(check(i, j))) throw std::runtime_error("invalid argument");
-        if (loc_map[i][j] == nullptr) {
+        if (loc_map[i * n + j] == nullptr) {
             if (id != -1 && loc_dict.find(id) != loc_dict.end())
                 throw std::runtime_error("duplicate id");
-            if (id == -1) id = static_cast<int>(loc_set.size());
-            loc_map[i][j] =
+            if (id == -1) id = static_cast<int>(loc_list.size());
+            loc_map[i * n + j] =
                 std::make_shared<Location>(id, Point{left_down.x() + i * x_step + x_step / 2,
                                                      left_down.y() + j * y_step + y_step / 2});
             loc_dict[id] = std::make_pair(i, j);
-            loc_set.emplace_back(loc_map[i][j]);
+            loc_list.emplace_back(loc_map[i * n + j]);
             int line_begin = GetConfig().ext_rate * i, line_end = GetConfig().ext_rate + line_begin;
             int col_begin = GetConfig().ext_rate * j, col_end = GetConfig().ext_rate + col_begin;
             for (int x = line_begin; x < line_end; ++x) {
                 for (int y = col_begin; y < col_end; ++y) {
-                    auto ptr = std::make_shared<ExtLocation>(
-                        id, ext_set.size(),
-                        Point{left_down.x() + x * x_step_ext + x_step_ext / 2,
-                              left_down.y() + y * y_step_ext + y_step_ext / 2});
-                    ext_set.emplace(ptr);
-                    ext_map[x][y] = ptr;
-                    ext_dict[ptr] = std::make_pair(x, y);
+                    auto h = ext_handle(x, y);
+                    ext_coarse[h] = id;
+                    ext_occupied[h >> 6] |= uint64_t(1) << (h & 63);
+                    ext_view[h] = std::make_shared<ExtLocation>(id, h, ext_point(h));
+                    ++ext_count;
                 }
             }
+            modified();
             return true;
         } else {
             return false;
@@ -138,7 +186,7 @@ class LocationMap {
         int col_begin = GetConfig().ext_rate * j, col_end = GetConfig().ext_rate + col_begin;
         for (int k = line_begin; k < line_end; ++k) {
             for (int l = col_begin; l < col_end; ++l) {
-                if (ext_map[k][l]) func(ext_map[k][l]);
+                if (occupied(ext_handle(k, l))) func(ext_view[ext_handle(k, l)]);
             }
         }
     }
@@ -158,11 +206,7 @@ class LocationMap {
     void remove_ext_point(Point point) {
         check(point);
         auto [i, j] = get_ext_index(point);
-        if (ext_map[i][j] != nullptr) {
-            ext_dict.erase(ext_map[i][j]);
-            ext_set.erase(ext_map[i][j]);
-            ext_map[i][j] = nullptr;
-        }
+        remove_ext(i, j);
     }
 
     void remove_ext_line(Point start, Point end) {
@@ -175,11 +219,7 @@ class LocationMap {
         R -= EPSILON;
         for (Point::value_type r = 0; r < R; r += dr, x += dx, y += dy) {
             auto [i, j] = get_ext_index(x, y);
-            if (ext_map[i][j] != nullptr) {
-                ext_dict.erase(ext_map[i][j]);
-                ext_set.erase(ext_map[i][j]);
-                ext_map[i][j] = nullptr;
-            }
+            remove_ext(i, j);
         }
     }
 
@@ -189,46 +229,117 @@ class LocationMap {
         if (x_end < m_ext) x_end++;
         if (y_end < n_ext) y_end++;
         for (; x < x_end; ++x) {
-            for (int _y = y; _y < y_end; ++_y) {
-                if (ext_map[x][_y] != nullptr) {
-                    ext_dict.erase(ext_map[x][_y]);
-                    ext_set.erase(ext_map[x][_y]);
-                    ext_map[x][_y] = nullptr;
-                }
-            }
+            for (int _y = y; _y < y_end; ++_y) remove_ext(x, _y);
         }
     }
 
-    auto& get_loc_dict() const { return loc_dict; }
+    // ---- ext cells by handle ----
+
+    ExtHandle ext_handle(int i, int j) const { return static_cast<ExtHandle>(i * n_ext + j); }
+
+    // the ext cell of a point, NO_EXT if out of the map or removed
+    ExtHandle ext_handle(Point const& point) const {
+        if (!check(point)) return NO_EXT;
+        int i = std::min(static_cast<int>((point.x() - left_down.x()) * x_ratio_ext), m_ext - 1);
+        int j = std::min(static_cast<int>((point.y() - left_down.y()) * y_ratio_ext), n_ext - 1);
+        auto h = ext_handle(i, j);
+        return occupied(h) ? h : NO_EXT;
+    }
+
+    // the cell of an ext location of this map, NO_EXT for any other location
+    ExtHandle ext_handle(LocationPtr const& loc) const {
+        if (!loc) return NO_EXT;
+        auto h = loc->ext;
+        return h < ext_view.size() && ext_view[h].get() == loc.get() ? h : NO_EXT;
+    }
+
+    bool occupied(ExtHandle h) const { return ext_occupied[h >> 6] >> (h & 63) & 1; }
+
+    std::pair<int, int> ext_cell(ExtHandle h) const { return {static_cast<int>(h) / n_ext, static_cast<int>(h) % n_ext}; }
 
-    auto& get_loc_list() const { return loc_set; }
+    Point ext_point(ExtHandle h) const { return {ext_x[h], ext_y[h]}; }
 
-    auto& get_ext_dict() const { return ext_dict; }
+    // the id of the coarse location of the cell
+    int ext_coarse_id(ExtHandle h) const { return ext_coarse[h]; }
 
-    auto& get_ext_list() const { return ext_set; }
+    LocationPtr const& ext_loc(ExtHandle h) const { return ext_view[h]; }
+
+    // the number of ext cells on the map
+    size_t ext_size() const { return ext_count; }
+
+    // ---- state index <-> handle ----
+
+    // the cell of every state of get_state_index()
+    std::span<ExtHandle const> state_handles() const {
+        get_state_index();
+        return state_handle;
+    }
+
+    // the state of a cell in get_state_index(), NO_STATE if it is not on the map
+    uint32_t state_of(ExtHandle h) const {
+        get_state_index();
+        return h == NO_EXT ? NO_STATE : handle_state[h];
+    }
+
+    auto& get_loc_dict() const { return loc_dict; }
+
+    auto& get_loc_list() const { return loc_list; }
+
+    // the ext locations, in grid order
+    StateIndex const& get_ext_list() const { return *get_state_index(); }
+
+    /**
+     * @brief dense index of the ext locations in grid order, shared by the markovs built on this
+     * map so that HMM can consume their transitions without remapping.
+     * */
+    StateIndexPtr const& get_state_index() const {
+        if (!state_index) {
+            std::vector<LocationPtr> ls;
+            ls.reserve(ext_count);
+            state_handle.clear();
+            state_handle.reserve(ext_count);
+            handle_state.assign(ext_view.size(), NO_STATE);
+            for (ExtHandle h = 0; h < ext_view.size(); ++h) {
+                if (!occupied(h)) continue;
+                handle_state[h] = static_cast<uint32_t>(ls.size());
+                state_handle.push_back(h);
+                ls.emplace_back(ext_view[h]);
+            }
+            state_index = std::make_shared<StateIndex>(ls);
+        }
+        return state_index;
+    }
 
     auto& get_loc_idx(LocationPtr loc) const {
         if (!(check(loc))) throw std::runtime_error("invalid argument");
         return loc_dict.at(loc->id);
     }
 
-    auto& get_loc(int i, int j) const { return loc_map.at(i).at(j); }
+    LocationPtr const& get_loc(int i, int j) const {
+        if (!check(i, j)) throw std::out_of_range("location out of the map");
+        return loc_map[i * n + j];
+    }
 
     auto& get_loc(int id) const {
         auto [i, j] = loc_dict.at(id);
-        return loc_map.at(i).at(j);
+        return loc_map[i * n + j];
     }
 
-    auto get_loc(Point const& point) const {
+    LocationPtr const& get_loc(Point const& point) const {
         int i = static_cast<int>((point.x() - left_down.x()) * x_ratio);
         int j = static_cast<int>((point.y() - left_down.y()) * y_ratio);
-        return loc_map.at(i).at(j);
+        return get_loc(i, j);
     }
 
-    auto get_ext_loc(Point const& point) const {
+    LocationPtr const& get_ext_loc(Point const& point) const {
         int i = static_cast<int>((point.x() - left_down.x()) * x_ratio_ext);
         int j = static_cast<int>((point.y() - left_down.y()) * y_ratio_ext);
-        return ext_map.at(i).at(j);
+        return get_ext_loc(i, j);
+    }
+
+    LocationPtr const& get_ext_loc(int i, int j) const {
+        if (i < 0 || i >= m_ext || j < 0 || j >= n_ext) throw std::out_of_range("ext cell out of the map");
+        return ext_view[ext_handle(i, j)];
     }
 
     auto get_loc_idx(Point const& point) const {
@@ -242,27 +353,74 @@ class LocationMap {
 
     auto get_map_col_size() const { return n; }
 
+    auto get_ext_row_size() const { return m_ext; }
+
+    auto get_ext_col_size() const { return n_ext; }
+
     auto x_range() const { return std::make_pair(left_down.x(), right_up.x()); }
 
     auto y_range() const { return std::make_pair(left_down.y(), right_up.y()); }
 
     auto step() const { return std::make_pair(x_step, y_step); }
 
+    auto ext_step() const { return std::make_pair(x_step_ext, y_step_ext); }
+
     void compute_distance() const;
 
-    Point::value_type distance(LocationPtr loc1, LocationPtr loc2) const {
+    /**
+     * @brief the key of everything derived from the geometry of the map (see cache.hpp): the grid,
+     * the removed ext cells, ext_rate, d0, ND_MU and ND_SIGMA.
+     * */
+    uint64_t cache_key() const;
+
+    /**
+     * @brief the ext locations within d0 of the ext location src (by the state index, see
+     * get_state_index), src included, sorted by index; their distances are in
+     * neighbour_distances(src).
+     * */
+    std::span<uint32_t const> neighbours(uint32_t src) const {
+        compute_distance();
+        return {neighbour_index.data() + neighbour_offset[src],
+                neighbour_index.data() + neighbour_offset[src + 1]};
+    }
+
+    std::span<float const> neighbour_distances(uint32_t src) const {
         compute_distance();
-        return dist_map.at(loc1).at(loc2);
+        return {neighbour_dist.data() + neighbour_offset[src],
+                neighbour_dist.data() + neighbour_offset[src + 1]};
+    }
+
+    /**
+     * @brief the distance of two ext locations, infinity if one of them is not on the map or they
+     * are farther than d0 from each other.
+     * */
+    Point::value_type distance(LocationPtr const& loc1, LocationPtr const& loc2) const {
+        return distance(ext_handle(loc1), ext_handle(loc2));
     }
 
     Point::value_type distance(Point const& p1, Point const& p2) const {
-        check(p1);
-        check(p2);
+        if (!check(p1) || !check(p2)) return std::numeric_limits<Point::value_type>::infinity();
         auto [i, j] = get_ext_index(p1);
         auto [x, y] = get_ext_index(p2);
-        compute_distance();
-        return dist_map.at(ext_map[i][j]).at(ext_map[x][y]);
+        return distance(ext_handle(i, j), ext_handle(x, y));
+    }
+
+    // the distance of two ext cells, see distance(LocationPtr, LocationPtr)
+    Point::value_type distance(ExtHandle h1, ExtHandle h2) const {
+        if (h1 == NO_EXT || h2 == NO_EXT || !occupied(h1) || !occupied(h2))
+            return std::numeric_limits<Point::value_type>::infinity();
+        auto [i, j] = ext_cell(h1);
+        auto [x, y] = ext_cell(h2);
+        // a step moves by one cell at most along each axis: out of the d0 box without a lookup
+        auto dd = GetConfig().d0;
+        if (std::abs(i - x) * x_step_ext > dd || std::abs(j - y) * y_step_ext > dd)
+            return std::numeric_limits<Point::value_type>::infinity();
+        auto src = state_of(h1), dst = state_of(h2);
+        auto row = neighbours(src);
+        auto it = std::lower_bound(row.begin(), row.end(), dst);
+        if (it == row.end() || *it != dst) return std::numeric_limits<Point::value_type>::infinity();
+        return neighbour_dist[neighbour_offset[src] + (it - row.begin())];
     }
 };
 
-}  // namespace rxy
\ No newline at end of file
+}  // namespace rxy
@@ -1,49 +1,133 @@
 #pragma once
+#include <algorithm>
+#include <execution>
+#include <list>
+#include <numeric>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "hmm/emission_prob.hpp"
+#include "hmm/matrix.hpp"
+#include "hmm/prob_simd.hpp"
 #include "hmm/probability.hpp"
 #include "location_map.hpp"
-#include "util.hpp"
+#include "rsrp_stats.hpp"
 
 namespace rxy {
 
+/**
+ * @brief The likelihood of a sample at every location, the rsrp of every pci being normally
+ * distributed around its mean at the location. The statistics are compiled into dense
+ * [pci x location] tables of (mu, 1 / sigma, log normalizer), a sample is scored by one vector pass
+ * over the locations per pci.
+ * */
 class MaxAPosteri {
    private:
-    // statistic data for each location's pci
-    // Location -> (pci -> statistic data)
-    std::unordered_map<LocationPtr, std::unordered_map<int, std::pair<double, double>>>
-        loc_pci_stats;
+    using value_type = Prob::value_type;
+
+    // the rows of the tables
+    std::vector<LocationPtr> locs;
+    // pci -> column of the tables
+    std::unordered_map<int, size_t> pci_column;
+    // of the rsrp of a pci at a location; all 0 if the pci was not measured there: it is then no
+    // evidence
+    ColumnMatrix<value_type> mu, inv_sigma, log_norm;
+    // per column, the (row, mu) of the pcis of sigma 0: probability 1 at mu, 0 elsewhere
+    std::vector<std::vector<std::pair<uint32_t, value_type>>> degenerate;
 
    public:
-    MaxAPosteri(
-        LocationMap const& loc_map,
-        std::unordered_map<int, std::unordered_map<int, std::list<RSRP_TYPE>>> const& loc_pci_map) {
-        for (auto&& [loc, pci_rsrp_map] : loc_pci_map) {
-            auto& pci_stats = loc_pci_stats[loc_map.get_loc(loc)];
-            for (auto&& [pci, rsrp_list] : pci_rsrp_map) {
-                pci_stats[pci] = get_mean_var(rsrp_list.begin(), rsrp_list.end(), static_cast<int>(rsrp_list.size()));
+    // from the stats of every (location, pci), see load_stats
+    MaxAPosteri(LocationMap const& loc_map,
+                std::unordered_map<int, std::unordered_map<int, RsrpStats>> const& loc_pci_stats) {
+        std::vector<int> loc_ids;
+        std::set<int> pcis;
+        loc_ids.reserve(loc_pci_stats.size());
+        for (auto&& [loc, pci_stats] : loc_pci_stats) {
+            loc_ids.push_back(loc);
+            for (auto&& [pci, _] : pci_stats) pcis.insert(pci);
+        }
+        std::sort(loc_ids.begin(), loc_ids.end());
+        for (auto pci : pcis) pci_column.emplace(pci, pci_column.size());
+
+        auto L = loc_ids.size(), P = pci_column.size();
+        mu = ColumnMatrix<value_type>(L, P);
+        inv_sigma = ColumnMatrix<value_type>(L, P);
+        log_norm = ColumnMatrix<value_type>(L, P);
+        degenerate.resize(P);
+        locs.reserve(L);
+        for (uint32_t row = 0; row < L; ++row) {
+            locs.emplace_back(loc_map.get_loc(loc_ids[row]));
+            for (auto&& [pci, stats] : loc_pci_stats.at(loc_ids[row])) {
+                if (stats.count == 0) continue;
+                auto column = pci_column.at(pci);
+                auto m = stats.mean, sigma = stats.variance();
+                if (sigma == 0) {
+                    degenerate[column].emplace_back(row, m);
+                    continue;
+                }
+                mu(row, column) = m;
+                inv_sigma(row, column) = 1. / sigma;
+                log_norm(row, column) = simd::log_nd_norm(sigma);
             }
         }
     }
 
+    // the locations, in the order of the log likelihoods
+    std::vector<LocationPtr> const& locations() const { return locs; }
+
     /**
-     *
+     * @brief the log likelihood of the sample at every location, into out[0, locations().size()).
+     * The pcis measured at no location are ignored.
      * */
-    std::unordered_map<LocationPtr, Prob> operator()(
-        std::list<std::pair<int, RSRP_TYPE>> const& X) const {
-        std::unordered_map<LocationPtr, Prob> loc_prob;
-        for (auto const& [loc, pci_rsrp_map] : loc_pci_stats) {
-            Prob p(0, true);
-            for (auto&& [pci, rsrp] : X) {
-                try {
-                    auto [mu, sigma] = pci_rsrp_map.at(pci);
-                    p *= log_nd_pdf(rsrp, mu, sigma);
-                } catch (std::out_of_range&) {
-                    // pci not found
-                }
+    void log_likelihood(std::list<std::pair<int, RSRP_TYPE>> const& X, value_type* out) const {
+        auto L = locs.size();
+        std::fill(out, out + L, 0);
+        for (auto&& [pci, rsrp] : X) {
+            auto it = pci_column.find(pci);
+            if (it == pci_column.end()) continue;
+            auto column = it->second;
+            simd::add_log_nd_pdf(rsrp, mu.column(column), inv_sigma.column(column), log_norm.column(column), out, L);
+            for (auto [row, m] : degenerate[column]) {
+                if (rsrp != m) out[row] = Prob::ZERO.prob;
             }
-            loc_prob[loc] = p;
         }
+    }
+
+    /**
+     * @brief the log likelihoods of every sample of a trace, T x locations().size(), the samples
+     * scored in parallel.
+     * */
+    std::vector<value_type> log_likelihood(std::vector<std::list<std::pair<int, RSRP_TYPE>>> const& samples) const {
+        auto L = locs.size();
+        std::vector<value_type> ret(samples.size() * L);
+        std::vector<size_t> ts(samples.size());
+        std::iota(ts.begin(), ts.end(), 0);
+        std::for_each(std::execution::par, ts.begin(), ts.end(),
+                      [this, &samples, &ret, L](size_t t) { log_likelihood(samples[t], ret.data() + t * L); });
+        return ret;
+    }
+
+    std::unordered_map<LocationPtr, Prob> operator()(std::list<std::pair<int, RSRP_TYPE>> const& X) const {
+        std::vector<value_type> log_prob(locs.size());
+        log_likelihood(X, log_prob.data());
+        std::unordered_map<LocationPtr, Prob> loc_prob;
+        loc_prob.reserve(locs.size());
+        for (size_t row = 0; row < locs.size(); ++row) loc_prob.emplace(locs[row], Prob(log_prob[row], true));
         return loc_prob;
     }
+
+    // the emission probs of every sample of a trace
+    std::vector<EmissionProb> operator()(std::vector<std::list<std::pair<int, RSRP_TYPE>>> const& samples) const {
+        auto L = locs.size();
+        auto log_prob = log_likelihood(samples);
+        std::vector<EmissionProb> ret(samples.size());
+        for (size_t t = 0; t < samples.size(); ++t) {
+            ret[t].reserve(L);
+            for (size_t row = 0; row < L; ++row) ret[t].emplace(locs[row]->key(), Prob(log_prob[t * L + row], true));
+        }
+        return ret;
+    }
 };
 
 }  // namespace rxy
@@ -0,0 +1,109 @@
+#pragma once
+#include <configure.hpp>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+
+namespace rxy {
+
+/**
+ * @brief Mean and (population) variance of a stream of rsrp, in one numerically stable pass
+ * (Welford), and the number of missing values (-140): with skip_missing they are only counted, not
+ * averaged. Two accumulators merge (Chan et al.), so a column can be summed by blocks or by threads.
+ * */
+struct RsrpStats {
+    static constexpr RSRP_TYPE MISSING = -140;
+
+    // the values averaged, the missing values seen
+    size_t count = 0, missing = 0;
+    double mean = 0, m2 = 0;
+    bool skip_missing = false;
+
+    RsrpStats() = default;
+
+    explicit RsrpStats(bool skip_missing) : skip_missing(skip_missing) {}
+
+    void push(RSRP_TYPE rsrp) {
+        if (rsrp == MISSING) {
+            ++missing;
+            if (skip_missing) return;
+        }
+        ++count;
+        double delta = rsrp - mean;
+        mean += delta / count;
+        m2 += delta * (rsrp - mean);
+    }
+
+    void merge(RsrpStats const& other) {
+        missing += other.missing;
+        if (other.count == 0) return;
+        if (count == 0) {
+            count = other.count;
+            mean = other.mean;
+            m2 = other.m2;
+            return;
+        }
+        auto n = count + other.count;
+        double delta = other.mean - mean;
+        mean += delta * other.count / n;
+        m2 += other.m2 + delta * delta * count * other.count / n;
+        count = n;
+    }
+
+    double variance() const { return count ? m2 / count : 0; }
+
+    /**
+     * @brief the stats of a contiguous column in one pass: the sums of the values shifted by the
+     * first one, kept in LANES independent lanes so that the loop vectorizes.
+     * */
+    static RsrpStats of(RSRP_TYPE const* x, size_t n, bool skip_missing = false) {
+        static constexpr size_t LANES = 8;
+        RsrpStats ret(skip_missing);
+        if (n == 0) return ret;
+        double shift = x[0];
+        double s1[LANES] = {}, s2[LANES] = {}, c[LANES] = {}, miss[LANES] = {};
+        auto add = [&](size_t l, RSRP_TYPE v) {
+            double is_missing = v == MISSING ? 1 : 0;
+            double keep = skip_missing ? 1 - is_missing : 1;
+            double d = (v - shift) * keep;
+            s1[l] += d;
+            s2[l] += d * d;
+            c[l] += keep;
+            miss[l] += is_missing;
+        };
+        size_t m = n - n % LANES;
+        for (size_t i = 0; i < m; i += LANES) {
+            for (size_t l = 0; l < LANES; ++l) add(l, x[i + l]);
+        }
+        for (size_t i = m; i < n; ++i) add(i - m, x[i]);
+        double sum1 = 0, sum2 = 0, count = 0, missing = 0;
+        for (size_t l = 0; l < LANES; ++l) {
+            sum1 += s1[l];
+            sum2 += s2[l];
+            count += c[l];
+            missing += miss[l];
+        }
+        ret.count = static_cast<size_t>(count);
+        ret.missing = static_cast<size_t>(missing);
+        if (ret.count) {
+            ret.mean = shift + sum1 / count;
+            ret.m2 = sum2 - sum1 * sum1 / count;
+            if (ret.m2 < 0) ret.m2 = 0;
+        }
+        return ret;
+    }
+
+    // the stats of [begin, end), by blocks if the values are contiguous
+    template <typename InputIterator>
+    static RsrpStats of(InputIterator begin, InputIterator end, bool skip_missing = false) {
+        if constexpr (std::contiguous_iterator<InputIterator>) {
+            return of(std::to_address(begin), static_cast<size_t>(end - begin), skip_missing);
+        } else {
+            RsrpStats ret(skip_missing);
+            for (; begin != end; ++begin) ret.push(*begin);
+            return ret;
+        }
+    }
+};
+
+}  // namespace rxy
@@ -0,0 +1,298 @@
+#include "stencil_markov.hpp"
+#include "geodesic.hpp"
+#include "hmm/location.hpp"
+#include "hmm/probability.hpp"
+#include <algorithm>
+#include <cmath>
+#include <configure.hpp>
+#include <execution>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace rxy {
+/**
+ * @brief distances from the center of a free (2R + 1) x (2R + 1) window of ext cells, searched the
+ * same way as LocationMap::compute_distance.
+ * */
+static std::vector<double> window_distance(int R, double x_step, double y_step, double dd) {
+    int W = 2 * R + 1;
+    std::vector<double> d(W * W, std::numeric_limits<double>::infinity());
+    GridGeodesic(W, W, x_step, y_step, std::vector<char>(W * W, 1))
+        .search(R * W + R, dd, [&d](int c, double dist) { d[c] = dist; });
+    return d;
+}
+
+void StencilMarkov::__init() {
+    auto &delta = sense.delta();
+    index = loc_map.get_state_index();
+    auto &ls = *index;
+    auto N = ls.size();
+    int M = loc_map.get_ext_row_size(), L = loc_map.get_ext_col_size();
+    auto [x_step, y_step] = loc_map.ext_step();
+    auto handles = loc_map.state_handles();
+    auto dd = GetConfig().d0;
+
+    // ---- displacement of every source in ext cells ----
+    std::vector<std::pair<int, int>> displacement(N);
+    std::vector<LocationMap::ExtHandle> target(N, LocationMap::NO_EXT);
+    std::vector<uint32_t> srcs(N);
+    std::iota(srcs.begin(), srcs.end(), 0);
+    std::for_each(std::execution::par_unseq, srcs.begin(), srcs.end(),
+        [this, &delta, handles, &displacement, &target](uint32_t src) {
+            auto to = loc_map.ext_handle(loc_map.ext_point(handles[src]) + delta);
+            if (to == LocationMap::NO_EXT) return;
+            auto [i, j] = loc_map.ext_cell(handles[src]);
+            auto [ti, tj] = loc_map.ext_cell(to);
+            displacement[src] = {ti - i, tj - j};
+            target[src] = to;
+        });
+
+    // ---- one kernel per distinct displacement ----
+    std::map<std::pair<int, int>, int> kernel_id;
+    std::vector<std::vector<std::tuple<int, int, Prob::value_type>>> kernel_cells;
+    std::vector<int> kernel_R;
+    for (uint32_t src = 0; src < N; ++src) {
+        if (target[src] == LocationMap::NO_EXT || kernel_id.count(displacement[src])) continue;
+        auto [a, b] = displacement[src];
+        kernel_id[displacement[src]] = static_cast<int>(kernel_cells.size());
+        // the radius the destinations must lie within, and the window it spans
+        double radius = 1.5 * std::sqrt(a * x_step * a * x_step + b * y_step * b * y_step);
+        int R = static_cast<int>(std::min(radius, dd) / std::min(x_step, y_step)) + 1;
+        auto d = window_distance(R, x_step, y_step, dd);
+        int W = 2 * R + 1;
+        auto &cells = kernel_cells.emplace_back();
+        for (int u = -R; u <= R; ++u) {
+            for (int v = -R; v <= R; ++v) {
+                auto dist = d[(u + R) * W + v + R];
+                if (dist != std::numeric_limits<double>::infinity() && dist <= dd && dist < radius) {
+                    cells.emplace_back(a + u, b + v, log_nd_pdf(dist).prob);
+                }
+            }
+        }
+        kernel_R.push_back(R);
+    }
+
+    // ---- padded grid ----
+    int pad = 0;
+    for (auto &&cells : kernel_cells) {
+        for (auto [di, dj, _] : cells) pad = std::max({pad, std::abs(di), std::abs(dj)});
+    }
+    stencil.N = N;
+    stencil.pad = pad;
+    stencil.stride = L + 2 * pad;
+    stencil.pad_index.assign((M + 2 * pad) * stencil.stride, Transition::NIL);
+    stencil.pos.resize(N);
+    for (uint32_t l = 0; l < N; ++l) {
+        auto [i, j] = loc_map.ext_cell(handles[l]);
+        auto p = (i + pad) * stencil.stride + j + pad;
+        stencil.pos[l] = p;
+        stencil.pad_index[p] = l;
+    }
+    for (auto &&cells : kernel_cells) {
+        auto &kernel = stencil.kernels.emplace_back();
+        for (auto [di, dj, w] : cells) {
+            kernel.offset.push_back(static_cast<ptrdiff_t>(di) * stencil.stride + dj);
+            kernel.weight.push_back(w);
+        }
+    }
+
+    // ---- removed cells: summed-area table ----
+    std::vector<int> missing((M + 1) * (L + 1), 0);
+    for (int i = 0; i < M; ++i) {
+        for (int j = 0; j < L; ++j) {
+            missing[(i + 1) * (L + 1) + j + 1] = !loc_map.occupied(loc_map.ext_handle(i, j)) +
+                                                 missing[i * (L + 1) + j + 1] +
+                                                 missing[(i + 1) * (L + 1) + j] -
+                                                 missing[i * (L + 1) + j];
+        }
+    }
+    auto missing_in = [&missing, M, L](int i0, int j0, int i1, int j1) {
+        i0 = std::max(i0, 0), j0 = std::max(j0, 0);
+        i1 = std::min(i1, M - 1) + 1, j1 = std::min(j1, L - 1) + 1;
+        return missing[i1 * (L + 1) + j1] - missing[i0 * (L + 1) + j1] -
+               missing[i1 * (L + 1) + j0] + missing[i0 * (L + 1) + j0];
+    };
+
+    // ---- sources described by a kernel, explicit rows for the others ----
+    stencil.kernel_of.assign(N, -1);
+    std::vector<std::vector<std::pair<uint32_t, Prob::value_type>>> out_edges(N);
+    std::for_each(
+        std::execution::par_unseq, srcs.begin(), srcs.end(),
+        [this, handles, &target, &displacement, &kernel_id, &kernel_R, &out_edges,
+         &missing_in](uint32_t src) {
+            auto to = target[src];
+            if (to == LocationMap::NO_EXT) return;
+            auto k = kernel_id.at(displacement[src]);
+            auto R = kernel_R[k];
+            auto [ti, tj] = loc_map.ext_cell(to);
+            if (missing_in(ti - R, tj - R, ti + R, tj + R) == 0) {
+                stencil.kernel_of[src] = k;
+                return;
+            }
+
+            // near removed cells: the same rows as LocMarkov
+            auto r = static_cast<float>(
+                1.5 * minkowski(loc_map.ext_point(handles[src]), loc_map.ext_point(to)));
+            auto from = loc_map.state_of(to);
+            auto dsts = loc_map.neighbours(from);
+            auto dists = loc_map.neighbour_distances(from);
+            auto &edges = out_edges[src];
+            for (size_t k = 0; k < dsts.size(); ++k) {
+                if (dists[k] < r) edges.emplace_back(dsts[k], log_nd_pdf(dists[k]).prob);
+            }
+        });
+    for (uint32_t src = 0; src < N; ++src) {
+        if (target[src] != LocationMap::NO_EXT && stencil.kernel_of[src] == -1) ++fallback;
+    }
+    _tran_prob = SparseTransition(N, out_edges);
+    stencil.explicit_rows = &_tran_prob;
+
+    stencil.rows.resize(N);
+    std::iota(stencil.rows.begin(), stencil.rows.end(), 0);
+
+#ifdef DEBUG
+    std::cout << "Stencil markov DONE: kernels = " << stencil.kernels.size()
+              << ", kernel size = " << kernel_size()
+              << ", irregular sources = " << irregular_size() << std::endl;
+#endif
+}
+
+Prob StencilMarkov::prob(LocationPtr const &src, LocationPtr const &dst) const {
+    auto s = index->at(src), t = index->at(dst);
+    auto k = stencil.kernel_of[s];
+    if (k == -1) return {_tran_prob(t, s), true};
+    auto &kernel = stencil.kernels[k];
+    auto off = static_cast<ptrdiff_t>(stencil.pos[t]) - static_cast<ptrdiff_t>(stencil.pos[s]);
+    for (size_t i = 0; i < kernel.offset.size(); ++i) {
+        if (kernel.offset[i] == off) return {kernel.weight[i], true};
+    }
+    return Prob::ZERO;
+}
+
+/**
+ * Per thread, not per transition: a markov and its transition are shared by the decodes, which may
+ * run concurrently. The workers of a product read the grids of the thread which called it.
+ * */
+std::vector<std::vector<Transition::value_type>> &StencilTransition::load_grids(value_type const *prev) const {
+    thread_local std::vector<std::vector<value_type>> grids;
+    grids.resize(kernels.size());
+    // only the cells of the sources of a kernel are read from its grid, the others are ZERO
+    for (auto &grid : grids) grid.assign(pad_index.size(), Prob::ZERO.prob);
+    for (uint32_t l = 0; l < N; ++l) {
+        if (kernel_of[l] != -1) grids[kernel_of[l]][pos[l]] = prev[l];
+    }
+    return grids;
+}
+
+void StencilTransition::max_product(value_type const *prev, value_type *cur, uint32_t *psi) const {
+    auto &grids = load_grids(prev);
+    std::for_each(std::execution::par_unseq, rows.begin(), rows.end(),
+        [this, &grids, prev, cur, psi](uint32_t dst) {
+            value_type max_prob = Prob::ZERO.prob;
+            uint32_t max_src = NIL;
+            auto p = pos[dst];
+            for (size_t k = 0; k < kernels.size(); ++k) {
+                auto &grid = grids[k];
+                auto &kernel = kernels[k];
+                for (size_t i = 0; i < kernel.offset.size(); ++i) {
+                    auto q = p - kernel.offset[i];
+                    value_type prob = grid[q] + kernel.weight[i];
+                    if (prob > max_prob) {
+                        max_prob = prob;
+                        max_src = pad_index[q];
+                    }
+                }
+            }
+            auto srcs = explicit_rows->row_src(dst);
+            auto probs = explicit_rows->row_prob(dst);
+            for (size_t k = 0; k < srcs.size(); ++k) {
+                value_type prob = prev[srcs[k]] + probs[k];
+                if (prob > max_prob) {
+                    max_prob = prob;
+                    max_src = srcs[k];
+                }
+            }
+            cur[dst] = max_prob;
+            psi[dst] = max_src;
+        });
+}
+
+void StencilTransition::max_product_sparse(value_type const *prev, std::vector<uint32_t> const &active,
+                                           value_type *cur, uint32_t *psi,
+                                           std::vector<uint32_t> &touched) const {
+    auto relax = [cur, psi, &touched](uint32_t dst, value_type prob, uint32_t src) {
+        if (psi[dst] == NIL) {
+            touched.push_back(dst);
+            cur[dst] = prob;
+            psi[dst] = src;
+        } else if (prob > cur[dst]) {
+            cur[dst] = prob;
+            psi[dst] = src;
+        }
+    };
+    for (auto src : active) {
+        auto k = kernel_of[src];
+        if (k == -1) {
+            auto dsts = explicit_rows->col_dst(src);
+            auto probs = explicit_rows->col_prob(src);
+            for (size_t i = 0; i < dsts.size(); ++i) relax(dsts[i], prev[src] + probs[i], src);
+            continue;
+        }
+        auto &kernel = kernels[k];
+        auto p = pos[src];
+        for (size_t i = 0; i < kernel.offset.size(); ++i) {
+            auto dst = pad_index[p + kernel.offset[i]];
+            if (dst != NIL) relax(dst, prev[src] + kernel.weight[i], src);
+        }
+    }
+}
+
+void StencilTransition::sum_product(value_type const *prev, value_type *cur) const {
+    auto &grids = load_grids(prev);
+    std::for_each(std::execution::par_unseq, rows.begin(), rows.end(),
+        [this, &grids, prev, cur](uint32_t dst) {
+            Prob sum;
+            auto p = pos[dst];
+            for (size_t k = 0; k < kernels.size(); ++k) {
+                auto &grid = grids[k];
+                auto &kernel = kernels[k];
+                for (size_t i = 0; i < kernel.offset.size(); ++i) {
+                    sum += Prob(grid[p - kernel.offset[i]] + kernel.weight[i], true);
+                }
+            }
+            auto srcs = explicit_rows->row_src(dst);
+            auto probs = explicit_rows->row_prob(dst);
+            for (size_t k = 0; k < srcs.size(); ++k) sum += Prob(prev[srcs[k]] + probs[k], true);
+            cur[dst] = sum.prob;
+        });
+}
+
+void StencilTransition::sum_product_transposed(value_type const *next, value_type *cur) const {
+    std::for_each(std::execution::par_unseq, rows.begin(), rows.end(),
+        [this, next, cur](uint32_t src) {
+            Prob sum;
+            auto k = kernel_of[src];
+            if (k == -1) {
+                auto dsts = explicit_rows->col_dst(src);
+                auto probs = explicit_rows->col_prob(src);
+                for (size_t i = 0; i < dsts.size(); ++i) sum += Prob(probs[i] + next[dsts[i]], true);
+            } else {
+                auto &kernel = kernels[k];
+                auto p = pos[src];
+                for (size_t i = 0; i < kernel.offset.size(); ++i) {
+                    auto dst = pad_index[p + kernel.offset[i]];
+                    if (dst != NIL) sum += Prob(kernel.weight[i] + next[dst], true);
+                }
+            }
+            cur[src] = sum.prob;
+        });
+}
+
+}  // namespace rxy
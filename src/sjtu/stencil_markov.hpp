@@ -0,0 +1,97 @@
+#pragma once
+#include "hmm/markov.hpp"
+#include "hmm/transition.hpp"
+#include "location_map.hpp"
+
+namespace rxy {
+
+/**
+ * @brief Transition which applies one kernel of log-probabilities over (di, dj) offsets of the
+ * ext grid as a 2-D max-plus sweep. The sources the kernel does not describe (those whose
+ * neighbourhood contains removed ext cells) are kept as explicit CSR rows.
+ * */
+class StencilTransition : public Transition {
+   private:
+    friend class StencilMarkov;
+
+    struct Kernel {
+        // offset from the source to the destination in the padded grid, and its log-probability
+        std::vector<ptrdiff_t> offset;
+        std::vector<value_type> weight;
+    };
+
+    size_t N = 0;
+    // the ext grid, padded by `pad` cells on every side so that the sweep needs no bounds check
+    int pad = 0;
+    size_t stride = 0;
+    // padded cell -> state, NIL outside the map or removed
+    std::vector<uint32_t> pad_index;
+    // state -> padded cell
+    std::vector<size_t> pos;
+    // one kernel per displacement, the sensation rounds to one or (on cell borders) a few of them
+    std::vector<Kernel> kernels;
+    // state -> kernel describing its out transitions, -1 if none does
+    std::vector<int> kernel_of;
+    // transitions of the sources no kernel describes
+    SparseTransition const* explicit_rows = nullptr;
+
+    std::vector<uint32_t> rows;
+
+    // prev in one padded grid per kernel, the scratch of the calling thread
+    std::vector<std::vector<value_type>>& load_grids(value_type const* prev) const;
+
+   public:
+    size_t size() const override { return N; }
+
+    void max_product(value_type const* prev, value_type* cur, uint32_t* psi) const override;
+
+    void max_product_sparse(value_type const* prev, std::vector<uint32_t> const& active,
+                            value_type* cur, uint32_t* psi,
+                            std::vector<uint32_t>& touched) const override;
+
+    void sum_product(value_type const* prev, value_type* cur) const override;
+
+    void sum_product_transposed(value_type const* next, value_type* cur) const override;
+};
+
+/**
+ * @brief Markov of a LocationMap whose transition for the sensation is the same relative stencil at
+ * every ext cell: P(l' -> l) only depends on the offset between l' and l, apart from borders and
+ * removed cells. The per-step cost is O(N * K) instead of O(N^2), K being the kernel size.
+ * */
+class StencilMarkov : public Markov {
+   private:
+    LocationMap const& loc_map; // need to ensure that loc_map is not out of scope or released before THIS instance
+    StencilTransition stencil;
+    // number of sources which fell back to explicit rows
+    size_t fallback = 0;
+
+    void __init();
+
+   public:
+    StencilMarkov(LocationMap const& loc_map, Sensation const& sense) : Markov(sense), loc_map(loc_map) {
+        __init();
+    }
+    StencilMarkov(LocationMap const& loc_map, Sensation &&sense) : Markov(std::move(sense)), loc_map(loc_map) {
+        __init();
+    }
+    // the stencil refers to the explicit rows of this instance
+    StencilMarkov(StencilMarkov const&) = delete;
+    StencilMarkov& operator=(StencilMarkov const&) = delete;
+    virtual ~StencilMarkov() = default;
+
+    Transition const& transition() const override { return stencil; }
+
+    Prob prob(LocationPtr const& src, LocationPtr const& dst) const override;
+
+    size_t kernel_size() const {
+        size_t K = 0;
+        for (auto&& kernel : stencil.kernels) K = std::max(K, kernel.offset.size());
+        return K;
+    }
+
+    // number of sources which fell back to explicit rows
+    size_t irregular_size() const { return fallback; }
+};
+
+}  // namespace rxy
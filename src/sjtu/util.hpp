@@ -18,33 +18,93 @@
 #include "hmm/markov.hpp"
 #include "hmm/sensation.hpp"
 #include "sjtu/loc_markov.hpp"
-#include "line_parser/parser.h"
-#include "sjtu/max_a_posteri.hpp"
+#include "sjtu/stencil_markov.hpp"
+#include "line_parser/columnar.h"
+#include "sjtu/cache.hpp"
+#include "sjtu/fingerprint.hpp"
+#include "sjtu/rsrp_stats.hpp"
 
 namespace rxy {
 
-inline bool load_data(
-    std::string const& file,
-    std::unordered_map<int, std::unordered_map<int, std::list<RSRP_TYPE>>>& loc_pci_map) {
-    std::ifstream in(file);
-    if (in.fail()) {
+/**
+ * @brief the rows of a CellInfo file, parsed in place from its mapping by chunks of lines on all
+ * the cores, see parse_columns_parallel
+ * @return false (reported) if the file can not be read or parsed
+ * */
+inline bool load_columns(std::string const& file, CellColumns& columns) {
+    auto mapped = MappedFile::open(file);
+    if (!mapped) {
         std::cerr << "Failed to open file" << std::endl;
-        in.close();
         return false;
     }
-    Parser parser(in);     // 构造时传入需要进行解析的文本
-    if (parser.parse()) {  // parse()进行解析；返回一个bool值表示是否解析成功
-        for (auto const& cellinfo : parser.get()) {  // parser.get() 获取所有的CellInfo
-            auto& pci_rsrp_map = loc_pci_map[cellinfo.loc];
-            for (auto&& [pci, rsrp] : cellinfo.pci_info_list) {
-                pci_rsrp_map[pci].push_back(rsrp->rsrp);
+    try {
+        columns = parse_columns_parallel({reinterpret_cast<char const*>(mapped->data()), mapped->size()});
+    } catch (ParseError const& e) {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief calls f(CellInfoView) on every row of a CellInfo file as it is parsed from its mapping,
+ * in bounded memory, see CellInfoStream. The fingerprints of the file are read instead if there
+ * are (see Fingerprints::of); they have no 4G/5G flag: the g5 of their rows is empty.
+ * @return false (reported) if the file can not be read or parsed; on a parse error f has seen the
+ * rows of the batches before it, the loaders below then leave their outputs unchanged
+ * */
+template <typename F>
+inline bool for_each_cell_info(std::string const& file, F&& f) {
+    if (auto fp = Fingerprints::of(file)) {
+        std::vector<int> pci;
+        std::vector<double> rsrp;
+        auto pci_order = fp.pci_order();
+        for (size_t r = 0; r < fp.size(); ++r) {
+            pci.clear();
+            rsrp.clear();
+            auto x = fp.row(r);
+            for (size_t c = 0; c < x.size(); ++c) {
+                if (std::isnan(x[c])) continue;
+                pci.push_back(pci_order[c]);
+                rsrp.push_back(x[c]);
             }
+            f(CellInfoView{fp.labels()[r], pci, rsrp, {}});
         }
-    } else {
-        in.close();
+        return true;
+    }
+    auto mapped = MappedFile::open(file);
+    if (!mapped) {
+        std::cerr << "Failed to open file" << std::endl;
+        return false;
+    }
+    std::string_view text(reinterpret_cast<char const*>(mapped->data()), mapped->size());
+    CellInfoStream stream(text, std::move(mapped));
+    try {
+        for (CellInfoView row : stream) f(row);
+    } catch (ParseError const& e) {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline bool load_data(
+    std::string const& file,
+    std::unordered_map<int, std::unordered_map<int, std::list<RSRP_TYPE>>>& loc_pci_map) {
+    // added to loc_pci_map once the whole file is parsed
+    std::unordered_map<int, std::unordered_map<int, std::list<RSRP_TYPE>>> loaded;
+    if (!for_each_cell_info(file, [&loaded](CellInfoView row) {
+            auto& pci_rsrp_map = loaded[row.loc];
+            for (size_t i = 0; i < row.size(); ++i) pci_rsrp_map[row.pci[i]].push_back(row.rsrp[i]);
+        }))
         return false;
+    for (auto&& [loc, pci_rsrp_map] : loaded) {
+        auto& to = loc_pci_map[loc];
+        for (auto&& [pci, rsrp_list] : pci_rsrp_map) {
+            auto& to_list = to[pci];
+            to_list.splice(to_list.end(), rsrp_list);
+        }
     }
-    in.close();
     return true;
 }
 
@@ -62,69 +122,67 @@ inline bool load_data_aligned(
     std::string const& file,
     std::list<std::pair<int, std::vector<RSRP_TYPE>>>& loc_data_aligned,
     std::vector<int> const& pci_order, RSRP_TYPE default_rsrp = -140) {
-    std::ifstream in(file);
-    if (in.fail()) {
-        std::cerr << "Failed to open file" << std::endl;
-        in.close();
-        return false;
+    if (auto fp = Fingerprints::of(file)) {
+        auto columns = fp.columns(pci_order);
+        for (size_t r = 0; r < fp.size(); ++r) {
+            std::vector<RSRP_TYPE> rsrp_aligned(pci_order.size());
+            fp.align(r, columns, default_rsrp, rsrp_aligned.data());
+            loc_data_aligned.emplace_back(fp.labels()[r], std::move(rsrp_aligned));
+        }
+        return true;
     }
     std::unordered_map<int, int> idx_map;
     idx_map.reserve(pci_order.size());
     for (size_t i = 0; i < pci_order.size(); ++i) {
         idx_map[pci_order[i]] = i;
     }
-    Parser parser(in);  // 构造时传入需要进行解析的文本
-    if (parser.parse()) {
-        for (auto const& cellinfo : parser.get()) {
-            // auto& rsrp_aligned =
-            //     loc_data_aligned[cellinfo.loc].emplace_back(pci_order.size(), default_rsrp);
+    // added to loc_data_aligned once the whole file is parsed
+    std::list<std::pair<int, std::vector<RSRP_TYPE>>> loaded;
+    if (!for_each_cell_info(file, [&](CellInfoView row) {
             std::vector<RSRP_TYPE> rsrp_aligned(pci_order.size(), default_rsrp);
-            for (auto&& [pci, rsrp] : cellinfo.pci_info_list) {
-                try {
-                    rsrp_aligned[idx_map.at(pci)] = rsrp->rsrp;
-                } catch (std::out_of_range&) {
-                }
+            for (size_t i = 0; i < row.size(); ++i) {
+                auto it = idx_map.find(row.pci[i]);
+                if (it != idx_map.end()) rsrp_aligned[it->second] = row.rsrp[i];
             }
-            loc_data_aligned.emplace_back(cellinfo.loc, std::move(rsrp_aligned));
-        }
-    } else {
-        in.close();
+            loaded.emplace_back(row.loc, std::move(rsrp_aligned));
+        }))
         return false;
-    }
-    in.close();
+    loc_data_aligned.splice(loc_data_aligned.end(), loaded);
     return true;
 }
 
 inline bool load_data_aggregated(std::string const& file,
     std::unordered_map<int, std::list<std::vector<RSRP_TYPE>>>& loc_data_map,
     std::vector<int> const& pci_order, RSRP_TYPE default_rsrp = -140) {
-    std::ifstream in(file);
-    if (in.fail()) {
-        std::cerr << "Failed to open file" << std::endl;
-        in.close();
-        return false;
+    if (auto fp = Fingerprints::of(file)) {
+        auto columns = fp.columns(pci_order);
+        for (size_t r = 0; r < fp.size(); ++r) {
+            std::vector<RSRP_TYPE> rsrp_aligned(pci_order.size());
+            fp.align(r, columns, default_rsrp, rsrp_aligned.data());
+            loc_data_map[fp.labels()[r]].emplace_back(std::move(rsrp_aligned));
+        }
+        return true;
     }
     std::unordered_map<int, int> idx_map;
     idx_map.reserve(pci_order.size());
     for (size_t i = 0; i < pci_order.size(); ++i) {
         idx_map[pci_order[i]] = i;
     }
-    Parser parser(in);
-    if (parser.parse()) {
-        for (auto && cellinfo : parser.get()) {
+    // added to loc_data_map once the whole file is parsed
+    std::unordered_map<int, std::list<std::vector<RSRP_TYPE>>> loaded;
+    if (!for_each_cell_info(file, [&](CellInfoView row) {
             std::vector<RSRP_TYPE> rsrp_aligned(pci_order.size(), default_rsrp);
-            for (auto && [pci, rsrp] : cellinfo.pci_info_list) {
-                try {
-                    rsrp_aligned[idx_map.at(pci)] = rsrp->rsrp;
-                } catch(std::out_of_range&) {}
+            for (size_t i = 0; i < row.size(); ++i) {
+                auto it = idx_map.find(row.pci[i]);
+                if (it != idx_map.end()) rsrp_aligned[it->second] = row.rsrp[i];
             }
-            loc_data_map[cellinfo.loc].emplace_back(std::move(rsrp_aligned));
-        }
-    } else {
-        in.close();
+            loaded[row.loc].emplace_back(std::move(rsrp_aligned));
+        }))
         return false;
+    for (auto&& [loc, data_list] : loaded) {
+        auto& to = loc_data_map[loc];
+        to.splice(to.end(), data_list);
     }
-    in.close();
     return true;
 }
 
@@ -132,6 +190,18 @@ inline bool load_data_aligned_xlsx(
     std::string const& dir_path,
     std::unordered_map<std::string, std::list<std::vector<RSRP_TYPE>>>& loc_data_aligned,
     std::unordered_map<int, int> const & pci_idx_map, RSRP_TYPE default_rsrp = -140) {
+    // the fingerprints of the directory, labelled by the names of the sheets
+    if (auto fp = Fingerprints::of(dir_path); fp && fp.has_names()) {
+        std::vector<int> pci_order(pci_idx_map.size());
+        for (auto&& [pci, idx] : pci_idx_map) pci_order[idx] = pci;
+        auto columns = fp.columns(pci_order);
+        for (size_t r = 0; r < fp.size(); ++r) {
+            std::vector<RSRP_TYPE> rsrp_aligned(pci_order.size());
+            fp.align(r, columns, default_rsrp, rsrp_aligned.data());
+            loc_data_aligned[std::string(fp.name(fp.labels()[r]))].emplace_back(std::move(rsrp_aligned));
+        }
+        return true;
+    }
     std::filesystem::path dir(dir_path);
     if (!std::filesystem::exists(dir) || !std::filesystem::is_directory(dir)) {
         std::cerr << "Invalid dir path" << std::endl;
@@ -263,38 +333,55 @@ inline std::map<int, int> get_pci_map(
 }
 
 /**
- * compute mean and variance of rsrp_vector
+ * @brief the rsrp stats of every (location, pci) of a file, accumulated as the rows are read: no
+ * list of the values is kept.
  * */
-template <typename InputIterator>
-requires std::input_iterator<InputIterator> &&
-    std::same_as<typename std::iterator_traits<InputIterator>::value_type, RSRP_TYPE>
-inline std::pair<double, double> get_mean_var(InputIterator begin, InputIterator end, int n = -1,
-                                              bool compute_min = true) {
-    if (n == -1) n = std::distance(begin, end);
-    if (!(n > 0)) throw std::runtime_error("invalid argument");
-    if (compute_min) {
-        double sum = std::accumulate(begin, end, 0);
-        double mean = sum / n;
-        sum = std::accumulate(begin, end, 0, [mean](double sum, double rsrp) {
-            return sum + (rsrp - mean) * (rsrp - mean);
-        });
-        double variance = sum / n;
-        return {mean, variance};
-    } else {
-        double sum = std::accumulate(
-            begin, end, 0, [](RSRP_TYPE sum, RSRP_TYPE rsrp) { return rsrp == -140 ? sum : sum + rsrp; });
-        double mean = sum / n;
-        sum = std::accumulate(begin, end, 0, [mean](double sum, double rsrp) {
-            return rsrp == -140 ? sum : sum + (rsrp - mean) * (rsrp - mean);
-        });
-        double variance = sum / n;
-        return {mean, variance};
+inline bool load_stats(std::string const& file,
+                       std::unordered_map<int, std::unordered_map<int, RsrpStats>>& loc_pci_stats) {
+    // merged into loc_pci_stats once the whole file is parsed
+    std::unordered_map<int, std::unordered_map<int, RsrpStats>> loaded;
+    if (!for_each_cell_info(file, [&loaded](CellInfoView row) {
+            auto& pci_stats = loaded[row.loc];
+            for (size_t i = 0; i < row.size(); ++i) pci_stats[row.pci[i]].push(row.rsrp[i]);
+        }))
+        return false;
+    for (auto&& [loc, pci_stats] : loaded) {
+        auto& to = loc_pci_stats[loc];
+        for (auto&& [pci, stats] : pci_stats) to[pci].merge(stats);
     }
+    return true;
 }
 
-inline KNN<RSRP_TYPE> get_knn(std::string const& file, std::vector<int> const& pci_order, int top_k = 300) {
+// the KNN of the rsrp emission, with the inverse-weighted euclidean distance
+using RsrpMetric = metric::InvWeightedEuclidean;
+using RsrpKNN = KNN<RSRP_TYPE, RsrpMetric>;
+
+inline RsrpKNN::Index get_knn_index(std::string const& name) {
+    using Index = RsrpKNN::Index;
+    if (name == "brute") return Index::brute;
+    if (name == "kd_tree") return Index::kd_tree;
+    if (name == "vp_tree") {
+        // the vp_tree pruning would lose neighbours of a distance which is not a metric
+        if (!RsrpMetric::metric) throw std::invalid_argument("knn index vp_tree: the rsrp distance is not a metric");
+        return Index::vp_tree;
+    }
+    if (name == "hnsw") return Index::hnsw;
+    throw std::invalid_argument("unknown knn index: " + name);
+}
+
+/**
+ * @param index: the neighbour search, see KNN::Index
+ * @param centroids: the rows of every location compressed to that many centroids (0: none), see
+ * KNN::compress
+ * */
+inline RsrpKNN get_knn(std::string const& file, std::vector<int> const& pci_order, int top_k = 300,
+                       RsrpKNN::Index index = get_knn_index(GetConfig().knn_index),
+                       int centroids = GetConfig().knn_centroids) {
     std::list<std::pair<int, std::vector<RSRP_TYPE>>> loc_data_aligned;
-    KNN<RSRP_TYPE> knn(top_k, KNN<RSRP_TYPE>::distance_inv_weighted_euc);
+    auto& conf = GetConfig();
+    HNSWParams hnsw{static_cast<size_t>(conf.hnsw_m), static_cast<size_t>(conf.hnsw_ef_construction),
+                    static_cast<size_t>(conf.hnsw_ef)};
+    RsrpKNN knn(top_k, {}, index, hnsw);
     if (load_data_aligned(file, loc_data_aligned, pci_order)) {
         std::cout << "load data success" << std::endl;
         // auto data = get_train_test_data(loc_data_aligned, 1.);
@@ -307,13 +394,18 @@ inline KNN<RSRP_TYPE> get_knn(std::string const& file, std::vector<int> const& p
             labels.emplace_back(label);
         }
         knn.train(std::move(data), std::move(labels));
+        if (centroids > 0) knn.compress(centroids);
         return knn;
     } else {
         throw std::runtime_error("load data failed");
     }
 }
 
-inline auto get_markov(std::string const & sensor_file, LocationMap const& loc_map) {
+/**
+ * @param stencil: build StencilMarkov (shift-invariant kernel) instead of LocMarkov
+ * */
+inline auto get_markov(std::string const & sensor_file, LocationMap const& loc_map,
+                       bool stencil = GetConfig().stencil_markov) {
     std::cout << "get_markov" << std::endl;
     static Point North{0, 1}, South{0, -1}, East{1, 0}, West{-1, 0}, Stop{0, 0};
     std::unordered_map<Sensation, MarkovPtr> markov_cache;
@@ -346,8 +438,13 @@ inline auto get_markov(std::string const & sensor_file, LocationMap const& loc_m
         }
         auto it = markov_cache.emplace(sensations.back(), nullptr).first;
         if (!it->second) {
-            std::cout << "loc_markov" << std::endl;
-            it->second = std::make_shared<LocMarkov>(loc_map, sensations.back());
+            if (stencil) {
+                std::cout << "stencil_markov" << std::endl;
+                it->second = std::make_shared<StencilMarkov>(loc_map, sensations.back());
+            } else {
+                std::cout << "loc_markov" << std::endl;
+                it->second = std::make_shared<LocMarkov>(loc_map, sensations.back());
+            }
         }
     }
     ifs.close();
@@ -363,27 +460,38 @@ inline auto get_markov(std::string const & sensor_file, LocationMap const& loc_m
     return markovs;
 }
 
+/**
+ * @param predictions: if not null, gets the label knn predicts for every test sample, from the same
+ * pass as the emission probabilities
+ * */
 inline void get_emission_prob_by_knn(
-    std::list<std::pair<int, std::vector<RSRP_TYPE>>> const& test_data_aligned, KNN<RSRP_TYPE> const& knn,
+    std::list<std::pair<int, std::vector<RSRP_TYPE>>> const& test_data_aligned, RsrpKNN const& knn,
     LocationMap const& loc_map, std::vector<EmissionProb>& emission_probs,
-    std::vector<LocationPtr>& locations, int T = -1) {
+    std::vector<LocationPtr>& locations, int T = -1, std::vector<int>* predictions = nullptr) {
     if (T != -1) {
         emission_probs.reserve(T);
         locations.reserve(T);
     }
+    std::vector<std::vector<RSRP_TYPE>> queries;
+    queries.reserve(test_data_aligned.size());
     for (auto&& [loc, rsrp_aligned] : test_data_aligned) {
         locations.emplace_back(loc_map.get_loc(loc));
-        std::vector<double> label_prob = knn.predict_prob(rsrp_aligned);
-        std::unordered_map<LocationPtr, Prob> prob_map;
+        queries.emplace_back(rsrp_aligned);
+    }
+    auto batch = knn.predict_prob_batch(queries);
+    if (predictions) predictions->reserve(predictions->size() + batch.size());
+    for (auto&& [label, label_prob] : batch) {
+        if (predictions) predictions->emplace_back(label);
+        EmissionProb prob_map;
         prob_map.reserve(loc_map.get_ext_list().size());
         for (auto&& _loc : loc_map.get_ext_list()) {
-            prob_map[_loc] = label_prob[_loc->id];
+            prob_map[_loc->key()] = label_prob[_loc->id];
         }
         emission_probs.emplace_back(std::move(prob_map));
     }
 }
 
-inline void get_emission_prob_by_dnn(std::list<std::pair<int, std::vector<RSRP_TYPE>>> const& test_data_aligned, KNN<RSRP_TYPE> const& knn,
+inline void get_emission_prob_by_dnn(std::list<std::pair<int, std::vector<RSRP_TYPE>>> const& test_data_aligned, RsrpKNN const& knn,
     LocationMap const& loc_map, std::vector<EmissionProb>& emission_probs,
     std::vector<LocationPtr>& locations, int T = -1) {
 
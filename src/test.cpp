@@ -5,6 +5,7 @@
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <sstream>
 
 
 #include <boost/graph/adjacency_list.hpp>
@@ -15,7 +16,9 @@
 #include "cout_color.hpp"
 #include "hmm/hmm.hpp"
 #include "hmm/knn.hpp"
+#include "hmm/online_viterbi.hpp"
 #include "registry.hpp"
+#include "sjtu/geodesic.hpp"
 #include "sjtu/loc_markov.hpp"
 #include "sjtu/location_map.hpp"
 #include "sjtu/max_a_posteri.hpp"
@@ -34,7 +37,7 @@
 using namespace std;
 using namespace rxy;
 
-unordered_map<int, unordered_map<int, list<RSRP_TYPE>>>
+unordered_map<int, unordered_map<int, RsrpStats>>
 load_original_data(string const &file);
 
 LocationMap load_loc_map();
@@ -220,15 +223,79 @@ inline void check_markov(MarkovPtr markov,
                          std::list<LocationPtr> const &loc_ls) {
     for (auto it = loc_ls.begin(); it != loc_ls.end(); ++it) {
         cout << __color::bg_blu() << (*it)->point << __color::bg_def() << endl;
-        auto &tran_prob = markov->get_tran_prob().at(*it);
         for (auto jt = loc_ls.begin(); jt != loc_ls.end(); ++jt) {
-            auto prob = tran_prob.at(*jt);
+            auto prob = markov->prob(*jt, *it);
             if (prob > 0.001)
                 cout << "\t-> " << (*jt)->point << ": " << prob << '\n';
         }
     }
 }
 
+/**
+ * the setup of the hmm jobs on the simulated data/1 (see simulation): the location map, the
+ * markovs of the sensor file, the test samples aligned by pciOrder and a uniform initial prob
+ * */
+struct HmmFixture {
+    string train_file = ROOT_DIR + "/data/1/train.txt";
+    string sensor_file = ROOT_DIR + "/data/1/test_sensor.txt";
+    string test_file = ROOT_DIR + "/data/1/test.txt";
+    LocationMap loc_map = load_loc_map();
+    vector<MarkovPtr> markovs = get_markov(sensor_file, loc_map);
+    size_t T = markovs.size() + 1;
+    std::list<std::pair<int, std::vector<RSRP_TYPE>>> test_data_aligned;
+    unordered_map<LocKey, Prob> init_probs;
+
+    HmmFixture() {
+        load_data_aligned(test_file, test_data_aligned, GetConfig().pci_order);
+        for (auto &&loc : loc_map.get_ext_list()) {
+            init_probs[loc->key()] = Prob::ONE;
+        }
+    }
+
+    // the emission probs of the T first test samples by knn, their locations and the knn labels
+    void emission(RsrpKNN const &knn, vector<EmissionProb> &emission_probs,
+                  vector<LocationPtr> &locations, vector<int> *predictions = nullptr) const {
+        get_emission_prob_by_knn(test_data_aligned, knn, loc_map, emission_probs, locations, T,
+                                 predictions);
+    }
+};
+
+struct Accuracy {
+    double accuracy;
+    double rmse;  // the error of a hit is 0
+};
+
+// predicted locations against the true ones
+inline Accuracy accuracy(vector<LocationPtr> const &locations, vector<LocationPtr> const &pred) {
+    int cnt = 0;
+    double rmse = 0;
+    for (size_t t = 0; t < locations.size(); ++t) {
+        if (locations[t]->id == pred[t]->id) {
+            ++cnt;
+        } else {
+            double dist = minkowski(locations[t]->point, pred[t]->point);
+            rmse += dist * dist;
+        }
+    }
+    return {(double)cnt / locations.size(), sqrt(rmse / locations.size())};
+}
+
+// knn labels against the true locations: -1 (no neighbour) is a miss that has no error
+inline Accuracy accuracy(vector<LocationPtr> const &locations, vector<int> const &labels,
+                         LocationMap const &loc_map) {
+    int cnt = 0;
+    double rmse = 0;
+    for (size_t t = 0; t < locations.size(); ++t) {
+        if (locations[t]->id == labels[t]) {
+            ++cnt;
+        } else if (labels[t] != -1) {
+            double dist = minkowski(locations[t]->point, loc_map.get_loc(labels[t])->point);
+            rmse += dist * dist;
+        }
+    }
+    return {(double)cnt / locations.size(), sqrt(rmse / locations.size())};
+}
+
 RUN_OFF(dnn) {
     string train_file = ROOT_DIR + "/data/train.txt";
     string sensor_file = ROOT_DIR + "/data/test_sensor.txt";
@@ -285,22 +352,16 @@ RUN_OFF(dnn) {
 }
 
 RUN(hmm_knn) {
-    string train_file = ROOT_DIR + "/data/1/train.txt";
-    string sensor_file = ROOT_DIR + "/data/1/test_sensor.txt";
-    string test_file = ROOT_DIR + "/data/1/test.txt";
-
     int top_k = 3000;
 
-    auto &pci_order = GetConfig().pci_order;
-    // ---- location map ----
-    auto loc_map = load_loc_map();
-    // ------ sensation & markov ------
-    auto markovs = get_markov(sensor_file, loc_map);
+    // ---- location map, sensation & markov, test data ----
+    HmmFixture fixture;
+    auto &[train_file, sensor_file, test_file, loc_map, markovs, T, test_data_aligned,
+           init_probs] = fixture;
     // check_markov(markovs[0], loc_map.get_loc_set());
-    auto T = markovs.size() + 1;
-    auto knn = get_knn(train_file, pci_order, top_k);
-    std::list<std::pair<int, std::vector<RSRP_TYPE>>> test_data_aligned;
-    load_data_aligned(test_file, test_data_aligned, pci_order);
+    // every row, the knnCentroids compression is compared below
+    auto knn = get_knn(train_file, GetConfig().pci_order, top_k,
+                       get_knn_index(GetConfig().knn_index), 0);
 
     for (auto &[loc, _] : test_data_aligned) {
         cout << loc_map.get_loc(loc)->point << endl;
@@ -308,16 +369,33 @@ RUN(hmm_knn) {
 
     cout << " =================== " << endl;
 
+    // ------ load data ------
+    // the knn predictions and the emission probs of the hmm come from the same batch
+    vector<EmissionProb> emission_probs;
+    vector<LocationPtr> locations;
+    vector<int> predictions;
+    cout << "get emission prob ..." << endl;
+    auto tik = std::chrono::high_resolution_clock::now();
+    fixture.emission(knn, emission_probs, locations, &predictions);
+    auto tok = std::chrono::high_resolution_clock::now();
+
+    using dur = std::chrono::duration<double, std::milli>;
+    auto emission_time = dur(tok - tik);
+    cout << "GOT: duration: " << emission_time << " ms" << endl;
+
     // ===== knn =====
     cout << __color::bg_blu() << "--- KNN ---" << __color::bg_def() << endl;
     int total = 0;
     int knn_cnt = 0;
     double knn_rmse = 0;
     for (auto &&[loc, data] : test_data_aligned) {
+        int pred = predictions[total];
         total++;
         cout << "t = " << total << endl;
-        int pred = knn.predict(data);
-        if (pred == loc) {
+        if (pred == -1) {
+            cout << "\t" << __color::gre() << loc_map.get_loc(loc)->point << __color::def()
+                 << " vs. no neighbour" << endl;
+        } else if (pred == loc) {
             cout << __color::gre() << "\t" << loc_map.get_loc(loc)->point
                  << __color::def() << endl;
             ++knn_cnt;
@@ -333,18 +411,6 @@ RUN(hmm_knn) {
     }
 
     cout << __color::bg_blu() << "--- HMM ---" << __color::bg_def() << endl;
-
-    // ------ load data ------
-    vector<EmissionProb> emission_probs;
-    vector<LocationPtr> locations;
-    cout << "get emission prob ..." << endl;
-    auto tik = std::chrono::high_resolution_clock::now();
-    get_emission_prob_by_knn(test_data_aligned, knn, loc_map, emission_probs,
-                             locations, T);
-    auto tok = std::chrono::high_resolution_clock::now();
-
-    using dur = std::chrono::duration<double, std::milli>;
-    cout << "GOT: duration: " << dur(tok - tik) << " ms" << endl;
     // {
     //     int t = 0;
     //     for (auto & emit_prob : emission_probs) {
@@ -353,17 +419,11 @@ RUN(hmm_knn) {
     //         ======================= " << endl;
     //     }
     // }
-    // ------ init prob -------
-    unordered_map<LocationPtr, Prob> init_probs;
-    for (auto &&loc : loc_map.get_ext_list()) {
-        // init_probs[loc] = emission_probs[0][loc];
-        init_probs[loc] = Prob::ONE;
-    }
     // ------ hmm ------
     cout << "viterbi ..." << endl;
     tik = std::chrono::high_resolution_clock::now();
-    auto pred_locs = HMM{loc_map.get_ext_list()}.viterbi(markovs, init_probs,
-                                                         emission_probs);
+    auto pred_locs = HMM{loc_map.get_state_index()}.viterbi(markovs, init_probs,
+                                                            emission_probs);
     tok = std::chrono::high_resolution_clock::now();
     cout << "GOT, duration: " << dur(tok - tik) << " ms" << endl;
     int cnt = 0;
@@ -391,30 +451,311 @@ RUN(hmm_knn) {
         }
     }
 
+    // ------ beam-pruned hmm ------
+    Beam beam{static_cast<size_t>(GetConfig().beam_width),
+              GetConfig().beam_threshold};
+    int beam_same = 0;
+    Accuracy beam_score{};
+    if (beam.enabled()) {
+        cout << "beam viterbi ..." << endl;
+        tik = std::chrono::high_resolution_clock::now();
+        auto beam_locs = HMM{loc_map.get_state_index()}.viterbi(
+            markovs, init_probs, emission_probs, beam);
+        tok = std::chrono::high_resolution_clock::now();
+        cout << "GOT, duration: " << dur(tok - tik) << " ms" << endl;
+        for (int t = 0; t < T; ++t) {
+            if (beam_locs[t] == pred_locs[t]) ++beam_same;
+        }
+        beam_score = accuracy(locations, beam_locs);
+    }
+
+    // ------ knn on the centroids of every location ------
+    int centroids = GetConfig().knn_centroids;
+    Accuracy comp_score{}, comp_knn_score{};
+    auto compressed = knn;
+    dur comp_time{};
+    if (centroids > 0) {
+        cout << "compress to " << centroids << " centroids per location ..." << endl;
+        compressed.compress(centroids);
+        vector<EmissionProb> comp_emission_probs;
+        vector<LocationPtr> comp_locations;
+        vector<int> comp_predictions;
+        tik = std::chrono::high_resolution_clock::now();
+        fixture.emission(compressed, comp_emission_probs, comp_locations, &comp_predictions);
+        tok = std::chrono::high_resolution_clock::now();
+        comp_time = tok - tik;
+        auto comp_locs = HMM{loc_map.get_state_index()}.viterbi(
+            markovs, init_probs, comp_emission_probs);
+        comp_score = accuracy(locations, comp_locs);
+        comp_knn_score = accuracy(locations, comp_predictions, loc_map);
+    }
+
     cout << "noise: " << GetConfig().noise << endl;
     cout << "HMM's accuracy = " << (double)cnt / T << endl;
     cout << "HMM's RMSE: " << sqrt(rmse / T) << endl;
+    if (beam.enabled()) {
+        cout << "beam: width = " << beam.width << ", threshold = " << beam.threshold << endl;
+        cout << "beam HMM's accuracy = " << beam_score.accuracy << " (lost "
+             << (double)cnt / T - beam_score.accuracy << ")" << endl;
+        cout << "beam HMM's RMSE: " << beam_score.rmse << endl;
+        cout << "beam HMM's agreement with exact decoding: " << (double)beam_same / T << endl;
+    }
     cout << "KNN's accuracy: " << static_cast<double>(knn_cnt) / total << endl;
     cout << "KNN's RMSE: " << sqrt(knn_rmse / total) << endl;
+    if (centroids > 0) {
+        cout << "centroids: " << centroids << " per location, " << knn.size() << " -> "
+             << compressed.size() << " rows, " << knn.memory() << " -> "
+             << compressed.memory() << " bytes" << endl;
+        cout << "centroids: emission probs in " << comp_time << " (vs. " << emission_time
+             << ")" << endl;
+        cout << "centroids HMM's accuracy = " << comp_score.accuracy << endl;
+        cout << "centroids HMM's RMSE: " << comp_score.rmse << endl;
+        cout << "centroids KNN's accuracy: " << comp_knn_score.accuracy << endl;
+        cout << "centroids KNN's RMSE: " << comp_knn_score.rmse << endl;
+    }
+}
+
+RUN_OFF(hmm_online) {
+    size_t lag = 5;
+    HmmFixture fixture;
+    auto &[train_file, sensor_file, test_file, loc_map, markovs, T, test_data_aligned,
+           init_probs] = fixture;
+    vector<EmissionProb> emission_probs;
+    vector<LocationPtr> locations;
+    fixture.emission(get_knn(train_file, GetConfig().pci_order, 3000), emission_probs, locations);
+
+    // one sample and one sensor step at a time
+    OnlineViterbi decoder(loc_map.get_state_index(), init_probs, lag);
+    vector<LocationPtr> committed;
+    using dur = std::chrono::duration<double, std::micro>;
+    for (size_t t = 0; t < T; ++t) {
+        auto tik = std::chrono::high_resolution_clock::now();
+        auto out = decoder.push(t ? markovs[t - 1] : nullptr, emission_probs[t]);
+        auto tok = std::chrono::high_resolution_clock::now();
+        committed.insert(committed.end(), out.committed.begin(), out.committed.end());
+        cout << "t = " << (t + 1) << ": " << out.best->point << " (" << dur(tok - tik)
+             << "), committed up to " << committed.size() << endl;
+    }
+    auto out = decoder.flush();
+    committed.insert(committed.end(), out.committed.begin(), out.committed.end());
+
+    auto [acc, rmse] = accuracy(locations, committed);
+    cout << "lag: " << lag << endl;
+    cout << "online HMM's accuracy = " << acc << endl;
+    cout << "online HMM's RMSE: " << rmse << endl;
+}
+
+RUN_OFF(hmm_posterior) {
+    HmmFixture fixture;
+    auto &[train_file, sensor_file, test_file, loc_map, markovs, T, test_data_aligned,
+           init_probs] = fixture;
+    vector<EmissionProb> emission_probs;
+    vector<LocationPtr> locations;
+    fixture.emission(get_knn(train_file, GetConfig().pci_order, 3000), emission_probs, locations);
+
+    HMM hmm{loc_map.get_state_index()};
+    auto tik = std::chrono::high_resolution_clock::now();
+    auto posterior = hmm.forward_backward(markovs, init_probs, emission_probs);
+    auto tok = std::chrono::high_resolution_clock::now();
+    cout << "forward-backward: " << std::chrono::duration<double, std::milli>(tok - tik) << endl;
+
+    // smoothed: the marginally most probable location and the expected position
+    // filtered: the same from the observations up to t only
+    ForwardFilter filter(loc_map.get_state_index(), init_probs);
+    int cnt = 0, filter_cnt = 0;
+    double rmse = 0, filter_rmse = 0, confidence = 0;
+    for (size_t t = 0; t < T; ++t) {
+        auto best = posterior.best(t);
+        if (locations[t]->id == best->id) ++cnt;
+        auto d = minkowski(locations[t]->point, posterior.expected(t));
+        rmse += d * d;
+        confidence += *posterior.at(t, best);
+
+        filter.push(t ? markovs[t - 1] : nullptr, emission_probs[t]);
+        if (locations[t]->id == filter.best()->id) ++filter_cnt;
+        d = minkowski(locations[t]->point, filter.expected());
+        filter_rmse += d * d;
+    }
+    cout << "posterior accuracy = " << (double)cnt / T << endl;
+    cout << "expected position RMSE: " << sqrt(rmse / T) << endl;
+    cout << "mean posterior of the best location: " << confidence / T << endl;
+    cout << "filtered accuracy = " << (double)filter_cnt / T << endl;
+    cout << "filtered expected position RMSE: " << sqrt(filter_rmse / T) << endl;
+}
+
+/**
+ * the parsing throughput of the CellInfo text (data/train.txt): the istream Parser against the
+ * columnar scanner, sequential and by parallel chunks, and the row stream
+ * */
+RUN_OFF(parse_throughput) {
+    string file = ROOT_DIR + "/data/train.txt";
+    auto mapped = MappedFile::open(file);
+    if (!mapped) {
+        cerr << "Failed to open file" << endl;
+        return;
+    }
+    string_view text(reinterpret_cast<char const *>(mapped->data()), mapped->size());
+    auto mb = text.size() / 1e6;
+    auto bench = [mb](char const *name, auto &&parse) {
+        constexpr int REPEAT = 5;
+        size_t rows = 0;
+        auto tik = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < REPEAT; ++i) rows = parse();
+        auto tok = std::chrono::high_resolution_clock::now();
+        cout << name << ": " << rows << " rows, "
+             << mb * REPEAT / std::chrono::duration<double>(tok - tik).count() << " MB/s" << endl;
+    };
+    bench("Parser", [&file] {
+        ifstream in(file);
+        Parser parser(in);
+        return parser.parse() ? parser.get().size() : 0;
+    });
+    bench("parse_columns", [text] { return parse_columns(text).size(); });
+    bench("parse_columns_parallel", [text] { return parse_columns_parallel(text).size(); });
+    bench("CellInfoStream", [text] {
+        CellInfoStream stream(text);
+        size_t rows = 0;
+        for (CellInfoView row : stream) rows += row.loc >= 0;
+        return rows;
+    });
+}
+
+/**
+ * parse_columns_parallel and CellInfoStream against the istream Parser, row by row, on
+ * data/train.txt; with small chunks too, so that the rows fall on many chunk and batch cuts. Then
+ * the number forms the Lexer accepts, beyond those of the file.
+ * */
+RUN_OFF(parse_compare) {
+    string file = ROOT_DIR + "/data/train.txt";
+    auto mapped = MappedFile::open(file);
+    if (!mapped) {
+        cerr << "Failed to open file" << endl;
+        return;
+    }
+    string_view text(reinterpret_cast<char const *>(mapped->data()), mapped->size());
+    ifstream in(file);
+    Parser parser(in);
+    if (!parser.parse()) {
+        cerr << "Parser failed" << endl;
+        return;
+    }
+    auto &expected = parser.get();
+    // what of row differs from the Parser's cell, nullptr if nothing
+    auto differ = [](CellInfo const &cell, CellInfoView const &row) -> char const * {
+        if (row.loc != cell.loc) return "loc";
+        if (row.size() != cell.pci_info_list.size()) return "size";
+        size_t i = 0;
+        for (auto &&[pci, info] : cell.pci_info_list) {
+            if (row.pci[i] != pci) return "pci";
+            if (row.rsrp[i] != info->rsrp) return "rsrp";
+            if (static_cast<bool>(row.g5[i]) != info->g5) return "5G";
+            ++i;
+        }
+        return nullptr;
+    };
+    auto compare = [&differ](string const &name, list<CellInfo> const &expected, auto &&rows) {
+        size_t r = 0, wrong = 0;
+        auto cell = expected.begin();
+        for (CellInfoView row : rows) {
+            auto what = cell == expected.end() ? "extra row" : differ(*cell++, row);
+            if (what && wrong++ == 0) cout << name << ": row " << r << " differs: " << what << endl;
+            ++r;
+        }
+        cout << name << ": " << r << " rows (Parser " << expected.size() << "), " << wrong
+             << " differ" << endl;
+    };
+    // the rows of the columns, as the views of a stream
+    auto views = [](CellColumns const &columns) {
+        vector<CellInfoView> rows;
+        for (size_t r = 0; r < columns.size(); ++r) {
+            auto i = columns.offset[r], n = columns.offset[r + 1] - i;
+            rows.push_back({columns.loc[r], span(columns.pci).subspan(i, n),
+                            span(columns.rsrp).subspan(i, n), span(columns.g5).subspan(i, n)});
+        }
+        return rows;
+    };
+    for (size_t chunk_bytes : {size_t(1) << 20, size_t(4096)}) {
+        auto suffix = " (" + to_string(chunk_bytes) + " byte chunks)";
+        auto columns = parse_columns_parallel(text, chunk_bytes);
+        compare("parse_columns_parallel" + suffix, expected, views(columns));
+        compare("CellInfoStream" + suffix, expected, CellInfoStream(text, nullptr, chunk_bytes));
+    }
+
+    // integral floats and exponents are integers, a '-' may be followed by spaces
+    string forms = "- 3: [<117.0, -88.5, 5G>, <1e2, - 7, 4G>]\n"
+                   "4: [<12, -  1.5e1, 5G>, <13, 2., 4G>]\n";
+    istringstream forms_in(forms);
+    Parser forms_parser(forms_in);
+    if (!forms_parser.parse()) {
+        cerr << "Parser failed on the number forms" << endl;
+        return;
+    }
+    compare("parse_columns (number forms)", forms_parser.get(), views(parse_columns(forms)));
+    compare("CellInfoStream (number forms)", forms_parser.get(), CellInfoStream(forms));
+}
+
+/**
+ * exact vs approximate (hnsw, with the hnsw knobs of the config) knn: recall@k and query time of
+ * the neighbour search, then the accuracy of the hmm on their emission probs
+ * */
+RUN_OFF(knn_ann) {
+    HmmFixture fixture;
+    auto &[train_file, sensor_file, test_file, loc_map, markovs, T, test_data_aligned,
+           init_probs] = fixture;
+    auto &pci_order = GetConfig().pci_order;
+    using dur = std::chrono::duration<double, std::milli>;
+    for (int top_k : {10, 50, 300, 3000}) {
+        auto exact = get_knn(train_file, pci_order, top_k, RsrpKNN::Index::brute);
+        auto tik = std::chrono::high_resolution_clock::now();
+        auto ann = get_knn(train_file, pci_order, top_k, RsrpKNN::Index::hnsw);
+        auto tok = std::chrono::high_resolution_clock::now();
+        cout << "top_k = " << top_k << ", hnsw built in " << dur(tok - tik) << endl;
+        double recall = 0, exact_time = 0, ann_time = 0;
+        for (auto &&[_, data] : test_data_aligned) {
+            tik = std::chrono::high_resolution_clock::now();
+            auto truth = exact.query(data);
+            tok = std::chrono::high_resolution_clock::now();
+            exact_time += dur(tok - tik).count();
+            tik = std::chrono::high_resolution_clock::now();
+            auto found = ann.query(data);
+            tok = std::chrono::high_resolution_clock::now();
+            ann_time += dur(tok - tik).count();
+            // a neighbour as near as the k-th exact one is a hit: the ties are interchangeable
+            auto kth = std::max_element(truth.begin(), truth.end())->first * (1 + 1e-9);
+            recall += static_cast<double>(std::count_if(found.begin(), found.end(),
+                                                        [kth](auto &p) { return p.first <= kth; })) /
+                      truth.size();
+        }
+        auto n = test_data_aligned.size();
+        cout << "\trecall@" << top_k << " = " << recall / n << ", query: exact " << exact_time / n
+             << " ms, hnsw " << ann_time / n << " ms" << endl;
+    }
+
+    HMM hmm{loc_map.get_state_index()};
+    for (auto index : {RsrpKNN::Index::brute, RsrpKNN::Index::hnsw}) {
+        auto knn = get_knn(train_file, pci_order, 3000, index);
+        vector<EmissionProb> emission_probs;
+        vector<LocationPtr> locations;
+        fixture.emission(knn, emission_probs, locations);
+        auto [acc, rmse] = accuracy(locations, hmm.viterbi(markovs, init_probs, emission_probs));
+        auto name = index == RsrpKNN::Index::brute ? "exact" : "hnsw";
+        cout << name << " HMM's accuracy = " << acc << endl;
+        cout << name << " HMM's RMSE: " << rmse << endl;
+    }
 }
 
 RUN_OFF(_map) {
     string file = "../data/train.txt";
     auto loc_map = load_loc_map();
-    unordered_map<int, unordered_map<int, list<RSRP_TYPE>>> loc_pci_map;
-    if (load_data(file, loc_pci_map)) {
-        cout << "load data success" << endl;
-    } else {
-        cerr << "load data failed" << endl;
-    }
-    MaxAPosteri __map(loc_map, loc_pci_map);
-    for (auto &&[loc, pci_rsrp_list] : loc_pci_map) {
-        list<pair<int, RSRP_TYPE>> rsrp_list;
-        for (auto &&[pci, rsrps] : pci_rsrp_list) {
-            for (auto &&rsrp : rsrps) {
-                rsrp_list.emplace_back(pci, rsrp);
-            }
-        }
+    auto loc_pci_stats = load_original_data(file);
+    // all the samples of a location, scored as one
+    unordered_map<int, list<pair<int, RSRP_TYPE>>> loc_samples;
+    for_each_cell_info(file, [&loc_samples](CellInfoView row) {
+        auto &rsrp_list = loc_samples[row.loc];
+        for (size_t i = 0; i < row.size(); ++i) rsrp_list.emplace_back(row.pci[i], row.rsrp[i]);
+    });
+    MaxAPosteri __map(loc_map, loc_pci_stats);
+    for (auto &&[loc, rsrp_list] : loc_samples) {
         auto loc_prob_map = __map(rsrp_list);
         LocationPtr max_loc = nullptr;
         Prob max_prob;
@@ -475,6 +816,77 @@ RUN_OFF(boost_graph_test) {
     }
 }
 
+/**
+ * GridGeodesic against boost's Dijkstra on the same 8-connected grid graph, bounded by d0 (as
+ * compute_distance runs it) and unbounded, on the map of load_loc_map and on it with obstacles
+ * */
+RUN_OFF(geodesic) {
+    auto check = [](char const *name, LocationMap const &loc_map) {
+        int m = loc_map.get_ext_row_size(), n = loc_map.get_ext_col_size();
+        auto [x_step, y_step] = loc_map.ext_step();
+        std::vector<char> free(m * n);
+        for (int c = 0; c < m * n; ++c) free[c] = loc_map.occupied(c);
+        GridGeodesic geodesic(m, n, x_step, y_step, free);
+
+        using graph_t =
+            boost::adjacency_list<boost::vecS, boost::vecS, boost::undirectedS, boost::no_property,
+                                  boost::property<boost::edge_weight_t, double>>;
+        graph_t g(m * n);
+        auto is_free = [&free, m, n](int i, int j) {
+            return i >= 0 && i < m && j >= 0 && j < n && free[i * n + j];
+        };
+        double diagonal = std::sqrt(x_step * x_step + y_step * y_step);
+        for (int i = 0; i < m; ++i) {
+            for (int j = 0; j < n; ++j) {
+                if (!is_free(i, j)) continue;
+                int c = i * n + j;
+                if (is_free(i, j + 1)) add_edge(c, c + 1, y_step, g);
+                if (is_free(i + 1, j)) add_edge(c, c + n, x_step, g);
+                // no diagonal through the corner of an obstacle
+                if (is_free(i + 1, j + 1) && is_free(i, j + 1) && is_free(i + 1, j))
+                    add_edge(c, c + n + 1, diagonal, g);
+                if (is_free(i + 1, j - 1) && is_free(i, j - 1) && is_free(i + 1, j))
+                    add_edge(c, c + n - 1, diagonal, g);
+            }
+        }
+
+        constexpr double INF = std::numeric_limits<double>::infinity();
+        constexpr double EPS = 1e-9;
+        size_t sources = 0, pairs = 0, missed = 0, wrong = 0;
+        double max_err = 0;
+        std::vector<double> dist(m * n), found(m * n);
+        for (int src = 0; src < m * n; ++src) {
+            if (!free[src]) continue;
+            ++sources;
+            // the cells boost does not reach keep the max of double
+            boost::dijkstra_shortest_paths(g, src, boost::distance_map(dist.data()));
+            for (double bound : {GetConfig().d0, INF}) {
+                std::fill(found.begin(), found.end(), INF);
+                geodesic.search(src, bound, [&found](int c, double d) { found[c] = d; });
+                for (int c = 0; c < m * n; ++c) {
+                    bool reached = free[c] && dist[c] != std::numeric_limits<double>::max();
+                    if (found[c] == INF) {
+                        // the cells on the bound may fall on either side of it
+                        if (reached && dist[c] < bound - EPS) ++missed;
+                        continue;
+                    }
+                    ++pairs;
+                    auto err = reached ? std::abs(found[c] - dist[c]) : INF;
+                    if (err > EPS) ++wrong;
+                    max_err = std::max(max_err, err);
+                }
+            }
+        }
+        cout << name << ": " << sources << " sources, " << pairs << " pairs found, " << missed
+             << " missed, " << wrong << " wrong, max error " << max_err << endl;
+    };
+    auto loc_map = load_loc_map();
+    check("open", loc_map);
+    loc_map.remove_ext_rect({4, 12}, {16, 28});
+    loc_map.remove_ext_rect({4, 4}, {16, 8});
+    check("obstacles", loc_map);
+}
+
 #include <OpenXLSX.hpp>
 
 RUN_OFF(OpenXLSX) {
@@ -0,0 +1,133 @@
+#include <OpenXLSX.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "line_parser/columnar.h"
+#include "sjtu/cache.hpp"
+#include "sjtu/fingerprint.hpp"
+
+/**
+ * fingerprint_convert <input> [output]
+ *
+ * Converts a CellInfo text, an xlsx sheet or a directory of xlsx sheets into a fingerprint file
+ * (see Fingerprints), by default next to the input with the extension .fp, where the loaders of
+ * util.hpp find it.
+ * */
+
+using namespace rxy;
+namespace fs = std::filesystem;
+
+static bool add_text(fs::path const& file, Fingerprints::Builder& builder) {
+    auto mapped = MappedFile::open(file);
+    if (!mapped) {
+        std::cerr << "Failed to open file " << file << std::endl;
+        return false;
+    }
+    std::string_view text(reinterpret_cast<char const*>(mapped->data()), mapped->size());
+    CellInfoStream stream(text, std::move(mapped));
+    try {
+        for (CellInfoView row : stream) builder.add(row.loc, row.pci, row.rsrp);
+    } catch (ParseError const& e) {
+        std::cerr << file << ": " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * as load_data_aligned_xlsx: a row is a sample of the (NR_PCI*, next column) pairs, labelled by the
+ * name of the file up to its first '.'; its timestamp is the numeric "Time" or "Timestamp" column,
+ * if there is one.
+ * */
+static bool add_xlsx(fs::path const& file, Fingerprints::Builder& builder) {
+    using namespace OpenXLSX;
+    auto name = file.filename().string();
+    auto label = builder.label_of(name.substr(0, name.find('.')));
+    try {
+        XLDocument doc(file.string());
+        auto book = doc.workbook();
+        auto sheet = book.worksheet(book.worksheetNames().front());
+        auto m = sheet.rowCount();
+        auto n = sheet.columnCount();
+        std::vector<decltype(n)> idx_list;
+        decltype(n) time_idx = 0;
+        for (decltype(n) j = 1; j <= n; ++j) {
+            std::string header;
+            try {
+                header = sheet.cell(1, j).value().get<std::string>();
+            } catch (XLException const&) {
+                continue;
+            }
+            if (header.starts_with("NR_PCI")) {
+                idx_list.push_back(j);
+            } else if (header == "Time" || header == "Timestamp") {
+                time_idx = j;
+            }
+        }
+        std::vector<int> pci;
+        std::vector<double> rsrp;
+        for (decltype(m) i = 2; i <= m; ++i) {
+            pci.clear();
+            rsrp.clear();
+            for (auto j : idx_list) {
+                try {
+                    auto p = sheet.cell(i, j).value().get<int>();
+                    auto v = sheet.cell(i, j + 1).value().get<double>();
+                    pci.push_back(p);
+                    rsrp.push_back(v);
+                } catch (XLException const&) {
+                }
+            }
+            auto t = std::numeric_limits<double>::quiet_NaN();
+            if (time_idx) {
+                try {
+                    t = sheet.cell(i, time_idx).value().get<double>();
+                } catch (XLException const&) {
+                }
+            }
+            builder.add(label, pci, rsrp, t);
+        }
+    } catch (XLException const& e) {
+        std::cerr << file << ": " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char const* argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "usage: " << argv[0] << " <CellInfo text | xlsx | directory of xlsx> [output]" << std::endl;
+        return 1;
+    }
+    fs::path input(argv[1]);
+    if (!input.has_filename()) input = input.parent_path();
+    auto output = argc == 3 ? fs::path(argv[2]) : fs::path(input).replace_extension(Fingerprints::EXTENSION);
+
+    // before reading, so that an edit during the conversion makes the file stale
+    auto source = Fingerprints::signature(input);
+    Fingerprints::Builder builder;
+    bool ok = true;
+    if (fs::is_directory(input)) {
+        std::vector<fs::path> sheets;
+        for (auto const& entry : fs::directory_iterator(input)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".xlsx") sheets.push_back(entry.path());
+        }
+        std::sort(sheets.begin(), sheets.end());
+        for (auto& sheet : sheets) ok = ok && add_xlsx(sheet, builder);
+    } else if (input.extension() == ".xlsx") {
+        ok = add_xlsx(input, builder);
+    } else {
+        ok = add_text(input, builder);
+    }
+    if (!ok) return 1;
+    if (!builder.write(output, source)) {
+        std::cerr << "can not write " << output << std::endl;
+        return 1;
+    }
+    std::cout << builder.size() << " samples written to " << output << std::endl;
+    return 0;
+}